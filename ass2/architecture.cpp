@@ -1,135 +1,661 @@
 #include "architecture.h"
 
+#include <algorithm>
 #include <array>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cmath>
 #include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <format>
 #include <thread>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 namespace Archi = Architecture;
 
 namespace {
-void parseInstructionsFromFile(const std::string file, std::vector<Architecture::Instruction>& instructions, bool& success) {
-  success = false; // start with fail, set to true if all done
-  std::ifstream fileStream(file);
-  if (!fileStream.is_open()) {
-    std::fprintf(stderr, "Failed to open file %s\n", file.c_str());
-    return;
+// Read only memory mapping of a whole file, unmapped on destruction
+class MappedFile {
+public:
+  explicit MappedFile(const std::string& file) {
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0) {
+      void* data = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        m_data = static_cast<const char*>(data);
+        m_size = fileStat.st_size;
+        madvise(data, m_size, MADV_SEQUENTIAL); // traces are read front to back once
+      }
+    }
+    close(fd);
   }
+  ~MappedFile() {
+    if (m_data != nullptr) munmap(const_cast<char*>(m_data), m_size);
+  }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool isMapped() const {return m_data != nullptr;}
+  const char* begin() const {return m_data;}
+  const char* end() const {return m_data + m_size;}
+  size_t size() const {return m_size;}
+
+private:
+  const char* m_data = nullptr;
+  size_t m_size = 0;
+};
+
+struct ParseStats {
+  bool success = false;
+  size_t bytesParsed = 0;
+  double parseSeconds = 0;
+};
+
+inline bool isWhitespace(const char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+inline const char* skipWhitespace(const char* ptr, const char* end) {
+  while (ptr < end && isWhitespace(*ptr)) ++ptr;
+  return ptr;
+}
+
+inline const char* tokenEnd(const char* ptr, const char* end) {
+  while (ptr < end && !isWhitespace(*ptr)) ++ptr;
+  return ptr;
+}
+
+// Compute cycles are held as an int, addresses may use all 64 bits
+inline bool isValueInRange(const Archi::INSTRUCTION_TYPE type, const uint64_t value) {
+  return type != Archi::COMPUTE || value <= uint64_t(std::numeric_limits<int>::max());
+}
+
+// Parsers hand each instruction to emit(type, value, numCoalesced), which returns false to stop parsing early
+template <typename EmitFn>
+bool parseTextTrace(const MappedFile& mappedFile, EmitFn&& emit) {
+  const char* ptr = mappedFile.begin();
+  const char* end = mappedFile.end();
 
-  std::string label, value;
   Archi::INSTRUCTION_TYPE type;
-  int intValue;
-  while (!fileStream.eof()) {
-    fileStream >> label >> value;
+  int label;
+  uint64_t value;
+  while ((ptr = skipWhitespace(ptr, end)) < end) {
     // Parse label
-    try {
-      type = static_cast<Archi::INSTRUCTION_TYPE>(std::stoi(label));
-    } catch (const std::exception& e) {
-      std::fprintf(stderr, "Failed to parse label %s: %s\n", label.c_str(), e.what());
-      return;
+    const char* labelEnd = tokenEnd(ptr, end);
+    auto [labelPtr, labelErr] = std::from_chars(ptr, labelEnd, label);
+    if (labelErr != std::errc() || labelPtr != labelEnd) {
+      std::fprintf(stderr, "Failed to parse label %.*s\n", int(labelEnd - ptr), ptr);
+      return false;
     }
 
+    type = static_cast<Archi::INSTRUCTION_TYPE>(label);
     if (!(type == Archi::LOAD || type == Archi::STORE || type == Archi::COMPUTE)) {
-      std::fprintf(stderr, "Invalid label %s\n", label.c_str());
-      return;
+      std::fprintf(stderr, "Invalid label %.*s\n", int(labelEnd - ptr), ptr);
+      return false;
     }
 
-    // Parse value
-    try {
-      intValue = std::stoi(value, nullptr, 16);
-    } catch (const std::exception& e) {
-      std::fprintf(stderr, "Failed to parse value %s: %s\n", value.c_str(), e.what());
-      return;
+    // Parse hex value, with optional 0x prefix
+    ptr = skipWhitespace(labelEnd, end);
+    const char* valueEnd = tokenEnd(ptr, end);
+    const char* digits = ptr;
+    if (valueEnd - digits > 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')) {
+      digits += 2;
+    }
+    auto [valuePtr, valueErr] = std::from_chars(digits, valueEnd, value, 16);
+    if (valueErr != std::errc() || valuePtr != valueEnd || !isValueInRange(type, value)) {
+      std::fprintf(stderr, "Failed to parse value %.*s\n", int(valueEnd - ptr), ptr);
+      return false;
     }
 
-    instructions.emplace_back(type, intValue);
+    if (!emit(type, value, 1)) return false;
+    ptr = valueEnd;
+  }
+  return true;
+}
+
+bool isBinaryTrace(const MappedFile& mappedFile) {
+  return mappedFile.size() >= sizeof(Archi::BinaryTraceHeader) && std::equal(mappedFile.begin(), mappedFile.begin() + 4, Archi::BINARY_TRACE_MAGIC);
+}
+
+// Compares by division so a corrupt record count cannot overflow into a matching size
+template <typename Record>
+bool binaryRecordsFitFile(const MappedFile& mappedFile, const uint64_t numRecords) {
+  if (mappedFile.size() < sizeof(Archi::BinaryTraceHeader)) return false;
+  const size_t recordBytes = mappedFile.size() - sizeof(Archi::BinaryTraceHeader);
+  return recordBytes % sizeof(Record) == 0 && numRecords == recordBytes / sizeof(Record);
+}
+
+// Number of instructions the trace holds, used to pre-size instruction vectors
+size_t countTraceInstructions(const MappedFile& mappedFile) {
+  if (isBinaryTrace(mappedFile)) {
+    Archi::BinaryTraceHeader header;
+    std::memcpy(&header, mappedFile.begin(), sizeof(header));
+    // Only trust the header once it matches the file, a bad header is then reported by the parser
+    const bool fitsFile = (header.version == Archi::BINARY_TRACE_VERSION && binaryRecordsFitFile<Archi::BinaryTraceRecord>(mappedFile, header.numRecords))
+                       || (header.version == Archi::BINARY_TRACE_32_BIT_VERSION && binaryRecordsFitFile<Archi::BinaryTraceRecord32>(mappedFile, header.numRecords));
+    return fitsFile ? header.numRecords : 0;
+  }
+  return std::count(mappedFile.begin(), mappedFile.end(), '\n') + 1; // each line holds one instruction
+}
+
+// Records are fixed width, copy them straight out of the mapping checking only the instruction type and compute cycles
+template <typename Record, typename EmitFn>
+bool emitBinaryRecords(const MappedFile& mappedFile, const uint64_t numRecords, EmitFn&& emit) {
+  if (!binaryRecordsFitFile<Record>(mappedFile, numRecords)) {
+    std::fprintf(stderr, "Binary trace size does not match its %lu records\n", (unsigned long) numRecords);
+    return false;
+  }
+  const Record* records = reinterpret_cast<const Record*>(mappedFile.begin() + sizeof(Archi::BinaryTraceHeader));
+  for (uint64_t recordIdx = 0; recordIdx < numRecords; ++recordIdx) {
+    const Record& record = records[recordIdx];
+    const Archi::INSTRUCTION_TYPE type = static_cast<Archi::INSTRUCTION_TYPE>(record.instType);
+    if (!(type == Archi::LOAD || type == Archi::STORE || type == Archi::COMPUTE)) {
+      std::fprintf(stderr, "Invalid instruction type %u in record %lu\n", unsigned(record.instType), (unsigned long) recordIdx);
+      return false;
+    }
+    if (!isValueInRange(type, record.getValue())) {
+      std::fprintf(stderr, "Failed to parse value %lu in record %lu\n", (unsigned long) record.getValue(), (unsigned long) recordIdx);
+      return false;
+    }
+    if (!emit(type, record.getValue(), record.numCoalesced)) return false;
   }
-  success = true; // successfully parsed
+  return true;
+}
+
+template <typename EmitFn>
+bool parseBinaryTrace(const MappedFile& mappedFile, EmitFn&& emit) {
+  Archi::BinaryTraceHeader header;
+  std::memcpy(&header, mappedFile.begin(), sizeof(header));
+  if (header.version == Archi::BINARY_TRACE_VERSION) {
+    return emitBinaryRecords<Archi::BinaryTraceRecord>(mappedFile, header.numRecords, emit);
+  }
+  if (header.version == Archi::BINARY_TRACE_32_BIT_VERSION) {
+    return emitBinaryRecords<Archi::BinaryTraceRecord32>(mappedFile, header.numRecords, emit);
+  }
+  std::fprintf(stderr, "Unsupported binary trace version %u, expected %u or %u\n", header.version, Archi::BINARY_TRACE_32_BIT_VERSION, Archi::BINARY_TRACE_VERSION);
+  return false;
+}
+
+// Writes to a temporary file and renames it so a concurrent reader never sees a partial trace
+template <typename Record>
+bool writeBinaryRecords(const std::filesystem::path& filePath, const uint16_t version, const uint16_t flags, const std::vector<Record>& records) {
+  Archi::BinaryTraceHeader header{};
+  std::memcpy(header.magic, Archi::BINARY_TRACE_MAGIC, sizeof(header.magic));
+  header.version = version;
+  header.flags = flags;
+  header.numRecords = records.size();
+
+  std::filesystem::path tempPath = filePath;
+  tempPath += ".tmp";
+  {
+    std::ofstream fileStream(tempPath, std::ios::binary | std::ios::trunc);
+    if (!fileStream.is_open()) {
+      std::fprintf(stderr, "Failed to open file %s for writing\n", tempPath.c_str());
+      return false;
+    }
+    fileStream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    fileStream.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(Record));
+    if (!fileStream.good()) {
+      std::fprintf(stderr, "Failed to write file %s\n", tempPath.c_str());
+      return false;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(tempPath, filePath, error);
+  if (error) {
+    std::fprintf(stderr, "Failed to rename %s to %s: %s\n", tempPath.c_str(), filePath.c_str(), error.message().c_str());
+    return false;
+  }
+  return true;
+}
+
+void parseInstructionsFromFile(const std::string file, std::vector<Architecture::Instruction>& instructions, ParseStats& stats) {
+  stats.success = false; // start with fail, set to true if all done
+  const auto startTime = std::chrono::steady_clock::now();
+  MappedFile mappedFile(file);
+  if (!mappedFile.isMapped()) {
+    std::fprintf(stderr, "Failed to open file %s\n", file.c_str());
+    return;
+  }
+
+  instructions.reserve(countTraceInstructions(mappedFile));
+  auto emit = [&instructions](Archi::INSTRUCTION_TYPE type, uint64_t value, int numCoalesced) {
+    instructions.emplace_back(type, value, numCoalesced);
+    return true;
+  };
+  if (!(isBinaryTrace(mappedFile) ? parseBinaryTrace(mappedFile, emit) : parseTextTrace(mappedFile, emit))) {
+    std::fprintf(stderr, "Failed to parse file %s\n", file.c_str());
+    return;
+  }
+
+  if (instructions.empty()) {
+    std::fprintf(stderr, "No instructions found in file %s\n", file.c_str());
+    return;
+  }
+
+  stats.bytesParsed = mappedFile.size();
+  stats.parseSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  stats.success = true; // successfully parsed
+}
+
+// Use the binary sidecar if it is at least as new as the text trace, or if there is no text trace
+bool isSidecarFresh(const std::filesystem::path& textPath, const std::filesystem::path& sidecarPath) {
+  std::error_code error;
+  if (!std::filesystem::exists(sidecarPath, error)) return false;
+  if (!std::filesystem::exists(textPath, error)) return true;
+  return std::filesystem::last_write_time(sidecarPath, error) >= std::filesystem::last_write_time(textPath, error);
+}
+
+std::string resolveTracePath(const std::filesystem::path& directory, const std::string& fileName, const int coreNum, bool& fromSidecar) {
+  std::filesystem::path filePath = directory / std::format("{}_{}.data", fileName, coreNum);
+  std::filesystem::path sidecarPath = filePath;
+  sidecarPath.replace_extension(Archi::BINARY_TRACE_EXTENSION);
+  fromSidecar = isSidecarFresh(filePath, sidecarPath);
+  return fromSidecar ? sidecarPath.string() : filePath.string();
+}
+
+std::ostream& printHistogram(std::ostream& os, const Archi::LatencyHistogram& histogram) {
+  return os << histogram.getNumSamples() << ", " << histogram.getPercentile(50) << ", " << histogram.getPercentile(90) << ", "
+            << histogram.getPercentile(99) << ", " << histogram.getMax();
 }
 } // anonymous namespace
 
 namespace Architecture {
-int GlobalCycleCounter::counter = 0;
-int GlobalReport::overallExecutionCycles = 0;
-std::array<int, Architecture::NUM_CORES> GlobalReport::numComputeInstructions;
-std::array<int, Architecture::NUM_CORES> GlobalReport::computeCycles;
-std::array<int, Architecture::NUM_CORES> GlobalReport::numLoadStoreInstructions;
-std::array<int, Architecture::NUM_CORES> GlobalReport::idleCycles;
-std::array<int, Architecture::NUM_CORES> GlobalReport::numCacheHits;
-std::array<int, Architecture::NUM_CORES> GlobalReport::numCacheMisses;
-int GlobalReport::busDataTrafficBytes = 0;
-int GlobalReport::busInvalidationsOrUpdates = 0;
-int GlobalReport::numPrivateAccess = 0;
-int GlobalReport::numSharedAccess = 0;
-
-void GlobalReport::clearReport() {
+long long LatencyHistogram::getNumSamples() const {
+  long long numSamples = 0;
+  for (long long count : m_counts) {
+    numSamples += count;
+  }
+  return numSamples;
+}
+
+long long LatencyHistogram::getPercentile(const double percentile) const {
+  const long long rank = std::max(1LL, (long long)std::ceil(percentile / 100.0 * getNumSamples())); // samples at or below it
+  long long numSamplesBelow = 0;
+  for (int bucketIdx = 0; bucketIdx < NUM_BUCKETS; ++bucketIdx) {
+    numSamplesBelow += m_counts[bucketIdx];
+    if (numSamplesBelow >= rank) {
+      if (bucketIdx < (1 << SUB_BUCKET_BITS)) return bucketIdx;
+      const int shift = (bucketIdx >> SUB_BUCKET_BITS) - 1;
+      const long long lowest = (1LL << SUB_BUCKET_BITS | (bucketIdx & ((1 << SUB_BUCKET_BITS) - 1))) << shift;
+      return std::min(lowest + (1LL << shift) - 1, m_max);
+    }
+  }
+  return 0;
+}
+
+void GlobalReport::clearReport(const int numCores) {
   overallExecutionCycles = 0;
-  numComputeInstructions.fill(0);
-  computeCycles.fill(0);
-  numLoadStoreInstructions.fill(0);
-  idleCycles.fill(0);
-  numCacheHits.fill(0);
-  numCacheMisses.fill(0);
+  numComputeInstructions.assign(numCores, 0);
+  computeCycles.assign(numCores, 0);
+  numLoadStoreInstructions.assign(numCores, 0);
+  idleCycles.assign(numCores, 0);
+  numCacheHits.assign(numCores, 0);
+  numCacheMisses.assign(numCores, 0);
+  outstandingMissCycles.assign(numCores, 0);
+  outstandingMissSum.assign(numCores, 0);
+  storeBufferOccupancySum.assign(numCores, 0);
+  storeBufferMaxOccupancy.assign(numCores, 0);
+  storeBufferFullStallCycles.assign(numCores, 0);
+  numForwardedLoads.assign(numCores, 0);
+  requestLatencyByCore.assign(numCores, {});
+  busQueueDepth.clear();
   busDataTrafficBytes = 0;
   busInvalidationsOrUpdates = 0;
   numPrivateAccess = 0;
   numSharedAccess = 0;
+  numCacheToCacheTransfers = 0;
+  cacheToCacheTransferCycles = 0;
+  numSnoopsAvoided = 0;
+  numMemorySlotStallCycles = 0;
+  numInFlightBlockStallCycles = 0;
+  numL2Hits = 0;
+  numL2Misses = 0;
+  numL2BackInvalidations = 0;
+  memoryTrafficBytes = 0;
+  l1MemoryTrafficBytes = 0;
+  numPrefetchesIssued = 0;
+  numUsefulPrefetches = 0;
+  numLatePrefetches = 0;
+  numDroppedPrefetches = 0;
+  prefetchBusDataTrafficBytes = 0;
+  numHybridUpdateLines = 0;
+  numHybridInvalidateLines = 0;
+  numHybridSwitchedLines = 0;
+  numHybridUpdatedCopies = 0;
+  numHybridInvalidatedCopies = 0;
+  std::fill(meshLinkBusyCycles.begin(), meshLinkBusyCycles.end(), 0);
+  numMeshMessages = 0;
+  meshMessageHops = 0;
+  numDramReads = 0;
+  numDramWrites = 0;
+  numDramRowHits = 0;
+  numDramRowMisses = 0;
+  numDramRowConflicts = 0;
+  numDramWriteBufferForwards = 0;
+  numDramWriteBufferFullStalls = 0;
+  dramReadLatencyCycles = 0;
 }
 
-std::ostream& printGlobalReport(std::ostream& os) {
+std::ostream& printGlobalReport(std::ostream& os, const GlobalReport& report) {
   os.precision(5);
-  os << "Report:\nOverall Execution Cycles: " << GlobalReport::overallExecutionCycles << '\n';
-  for (int coreNum = 0; coreNum < NUM_CORES ; ++coreNum) {
+  os << "Report:\nOverall Execution Cycles: " << report.overallExecutionCycles << '\n';
+  for (int coreNum = 0; coreNum < report.getNumCores(); ++coreNum) {
     os << "Core " << coreNum << '\n';
-    os << "\tTotal Instructions: " << GlobalReport::numComputeInstructions[coreNum] + GlobalReport::numLoadStoreInstructions[coreNum] << '\n';
-    os << "\t\tNum Compute Inst: " << GlobalReport::numComputeInstructions[coreNum] << '\n';
-    os << "\t\tNum Load Store Inst: " << GlobalReport::numLoadStoreInstructions[coreNum] << '\n';
+    os << "\tTotal Instructions: " << report.numComputeInstructions[coreNum] + report.numLoadStoreInstructions[coreNum] << '\n';
+    os << "\t\tNum Compute Inst: " << report.numComputeInstructions[coreNum] << '\n';
+    os << "\t\tNum Load Store Inst: " << report.numLoadStoreInstructions[coreNum] << '\n';
+
+    os << "\tTotal Execution Cycles: " << report.computeCycles[coreNum] + report.idleCycles[coreNum] << '\n';
+    os << "\t\tCompute Cycles: " << report.computeCycles[coreNum] << '\n';
+    os << "\t\tIdle Cycles: " << report.idleCycles[coreNum] << '\n';
+    if (report.numMshrs > 0) {
+      os << "\t\tMemory Level Parallelism: " << (report.outstandingMissCycles[coreNum] ? float(report.outstandingMissSum[coreNum]) / float(report.outstandingMissCycles[coreNum]) : 0.0f) << '\n';
+    }
+    if (report.storeBufferDepth > 0) {
+      os << "\t\tStore Buffer Full Stall Cycles: " << report.storeBufferFullStallCycles[coreNum] << '\n';
+      os << "\tStore Buffer Average Occupancy: " << (report.overallExecutionCycles ? double(report.storeBufferOccupancySum[coreNum]) / double(report.overallExecutionCycles) : 0.0) << '\n';
+      os << "\t\tMax Store Buffer Occupancy: " << report.storeBufferMaxOccupancy[coreNum] << '\n';
+      os << "\t\tNum Forwarded Loads: " << report.numForwardedLoads[coreNum] << '\n';
+    }
 
-    os << "\tTotal Execution Cycles: " << GlobalReport::computeCycles[coreNum] + GlobalReport::idleCycles[coreNum] << '\n';
-    os << "\t\tCompute Cycles: " << GlobalReport::computeCycles[coreNum] << '\n';
-    os << "\t\tIdle Cycles: " << GlobalReport::idleCycles[coreNum] << '\n';
+    os << "\tCache Hit Rate: " << float(report.numCacheHits[coreNum]) / float(report.numCacheHits[coreNum] + report.numCacheMisses[coreNum]) << '\n';
+    os << "\t\tNum Cache Hits: " << report.numCacheHits[coreNum] << '\n';
+    os << "\t\tNum Cache Misses: " << report.numCacheMisses[coreNum] << '\n';
 
-    os << "\tCache Hit Rate: " << float(GlobalReport::numCacheHits[coreNum]) / float(GlobalReport::numCacheHits[coreNum] + GlobalReport::numCacheMisses[coreNum]) << '\n';
-    os << "\t\tNum Cache Hits: " << GlobalReport::numCacheHits[coreNum] << '\n';
-    os << "\t\tNum Cache Misses: " << GlobalReport::numCacheMisses[coreNum] << '\n';
+    constexpr const char* SOURCE_NAMES[] = {"Hit", "Cache to Cache", "Memory"};
+    os << "\tLoad/Store Latency (count, p50, p90, p99, max):\n";
+    for (int source = 0; source < NUM_REQUEST_SOURCES; ++source) {
+      os << "\t\t" << SOURCE_NAMES[source] << ": ";
+      printHistogram(os, report.requestLatencyByCore[coreNum][source]) << '\n';
+    }
   }
   os << '\n';
-  os << "Total Bus Data Traffic (Bytes): " << GlobalReport::busDataTrafficBytes << '\n';
-  os << "Total Bus Invalidations/Updates: " << GlobalReport::busInvalidationsOrUpdates << '\n';  
-  os << "Total Private Data Access: " << GlobalReport::numPrivateAccess << '\n';
-  os << "Total Shared Data Access: " << GlobalReport::numSharedAccess << '\n';
-  float totalDataAccess = GlobalReport::numPrivateAccess + GlobalReport::numSharedAccess;
-  os << "Private Data Access Rate: " << float(GlobalReport::numPrivateAccess) / totalDataAccess << '\n';
-  os << "Shared Data Access Rate: " << float(GlobalReport::numSharedAccess) / totalDataAccess;
+  os << "Total Bus Data Traffic (Bytes): " << report.busDataTrafficBytes << '\n';
+  os << "Total Bus Invalidations/Updates: " << report.busInvalidationsOrUpdates << '\n';  
+  os << "Total Private Data Access: " << report.numPrivateAccess << '\n';
+  os << "Total Shared Data Access: " << report.numSharedAccess << '\n';
+  float totalDataAccess = report.numPrivateAccess + report.numSharedAccess;
+  os << "Private Data Access Rate: " << float(report.numPrivateAccess) / totalDataAccess << '\n';
+  os << "Shared Data Access Rate: " << float(report.numSharedAccess) / totalDataAccess;
+  os << "\nTotal Cache to Cache Transfers: " << report.numCacheToCacheTransfers;
+  os << "\nAverage Cache to Cache Transfer Cycles: " << (report.numCacheToCacheTransfers ? double(report.cacheToCacheTransferCycles) / report.numCacheToCacheTransfers : 0.0);
+  os << "\nBus Queue Depth (cycles, p50, p90, p99, max): ";
+  printHistogram(os, report.busQueueDepth);
+  if (report.snoopFilterEnabled) {
+    os << "\nTotal Snoops Avoided by Snoop Filter: " << report.numSnoopsAvoided;
+  }
+  if (report.splitBusMemorySlots > 0) {
+    os << "\nSplit Bus Outstanding Memory Transactions: " << report.splitBusMemorySlots;
+    os << "\nTotal Bus Stall Cycles for Memory Slots: " << report.numMemorySlotStallCycles;
+    os << "\nTotal Bus Stall Cycles for In Flight Blocks: " << report.numInFlightBlockStallCycles;
+  }
+  if (report.l2CacheSize > 0) {
+    os << "\nL2 Cache Hit Rate: " << float(report.numL2Hits) / float(report.numL2Hits + report.numL2Misses);
+    os << "\n\tNum L2 Cache Hits: " << report.numL2Hits;
+    os << "\n\tNum L2 Cache Misses: " << report.numL2Misses;
+    os << "\nTotal L2 Back Invalidations: " << report.numL2BackInvalidations;
+    os << "\nTotal Memory Traffic (Bytes): " << report.memoryTrafficBytes;
+    os << "\nMemory Traffic Saved by L2 (Bytes): " << report.l1MemoryTrafficBytes - report.memoryTrafficBytes;
+  }
+  if (report.prefetchingEnabled) {
+    os << "\nTotal Prefetches Issued: " << report.numPrefetchesIssued;
+    os << "\n\tNum Useful Prefetches: " << report.numUsefulPrefetches;
+    os << "\n\tNum Late Prefetches: " << report.numLatePrefetches;
+    os << "\n\tNum Dropped Prefetches: " << report.numDroppedPrefetches;
+    os << "\nPrefetch Accuracy: " << (report.numPrefetchesIssued ? float(report.numUsefulPrefetches) / float(report.numPrefetchesIssued) : 0.0f);
+    os << "\nPrefetch Bus Data Traffic (Bytes): " << report.prefetchBusDataTrafficBytes;
+  }
+  if (report.meshWidth > 0) {
+    constexpr const char* PORT_NAMES[] = {"East", "West", "North", "South"};
+    os << "\nMesh Dimensions: " << report.meshWidth << 'x' << report.meshHeight;
+    os << "\nTotal Mesh Messages: " << report.numMeshMessages;
+    os << "\nAverage Hops per Message: " << (report.numMeshMessages ? double(report.meshMessageHops) / report.numMeshMessages : 0.0);
+    os << "\nMesh Link Utilisation:";
+    for (int node = 0; node < report.meshWidth * report.meshHeight; ++node) {
+      const int x = node % report.meshWidth;
+      const int y = node / report.meshWidth;
+      const bool hasLink[] = {x + 1 < report.meshWidth, x > 0, y > 0, y + 1 < report.meshHeight};
+      for (int port = 0; port < 4; ++port) {
+        if (!hasLink[port]) continue;
+        os << "\n\t(" << x << ',' << y << ") " << PORT_NAMES[port] << ": " << double(report.meshLinkBusyCycles[node * 4 + port]) / std::max(report.overallExecutionCycles, 1LL);
+      }
+    }
+  }
+  if (report.dramChannels > 0) {
+    const long long numDramAccesses = report.numDramRowHits + report.numDramRowMisses + report.numDramRowConflicts;
+    os << "\nDRAM Channels x Banks: " << report.dramChannels << 'x' << report.dramBanks;
+    os << "\nTotal DRAM Reads: " << report.numDramReads;
+    os << "\nTotal DRAM Writes: " << report.numDramWrites;
+    os << "\nDRAM Row Buffer Hit Rate: " << (numDramAccesses ? float(report.numDramRowHits) / float(numDramAccesses) : 0.0f);
+    os << "\n\tNum Row Hits: " << report.numDramRowHits;
+    os << "\n\tNum Row Misses: " << report.numDramRowMisses;
+    os << "\n\tNum Row Conflicts: " << report.numDramRowConflicts;
+    os << "\nAverage DRAM Read Latency: " << (report.numDramReads ? double(report.dramReadLatencyCycles) / report.numDramReads : 0.0);
+    os << "\nTotal Reads Forwarded from Write Buffer: " << report.numDramWriteBufferForwards;
+    os << "\nTotal Write Buffer Full Stalls: " << report.numDramWriteBufferFullStalls;
+  }
+  if (report.hybridUpdateThreshold > 0) {
+    os << "\nHybrid Update Threshold: " << report.hybridUpdateThreshold;
+    os << "\nLines in Update Mode: " << report.numHybridUpdateLines;
+    os << "\nLines in Invalidate Mode: " << report.numHybridInvalidateLines;
+    os << "\nLines Switched Between Modes: " << report.numHybridSwitchedLines;
+    os << "\nTotal Copies Updated: " << report.numHybridUpdatedCopies;
+    os << "\nTotal Copies Invalidated: " << report.numHybridInvalidatedCopies;
+    if (report.mesiBusDataTrafficBytes >= 0) {
+      os << "\nBus Data Traffic Saved vs MESI (Bytes): " << report.mesiBusDataTrafficBytes - report.busDataTrafficBytes;
+    }
+    if (report.dragonBusDataTrafficBytes >= 0) {
+      os << "\nBus Data Traffic Saved vs Dragon (Bytes): " << report.dragonBusDataTrafficBytes - report.busDataTrafficBytes;
+    }
+  }
+  if (report.sharingProfileTopLines > 0) {
+    os << "\nTotal Blocks Accessed: " << report.numProfiledLines;
+    os << "\n\tNum Accessed by Multiple Cores: " << report.numSharedLines;
+    os << "\nTotal True Sharing Invalidations or Updates: " << report.numTrueSharingEvents;
+    os << "\nTotal False Sharing Invalidations or Updates: " << report.numFalseSharingEvents;
+    os << "\nTotal Ownership Ping-Pongs: " << report.numOwnershipPingPongs;
+    os << "\nHottest Shared Blocks (invalidations, updates, ping-pongs, true sharing, false sharing, sharers):";
+    for (const SharedLineReport& line : report.hottestSharedLines) {
+      os << "\n\t0x" << std::hex << line.blockAddress << std::dec << ": " << line.numInvalidations << ", " << line.numUpdates << ", " << line.numPingPongs << ", "
+         << line.numTrueSharing << ", " << line.numFalseSharing << ", {";
+      const char* separator = "";
+      for (int coreNum = 0; coreNum < 64; ++coreNum) {
+        if (line.sharers >> coreNum & 1) {
+          os << separator << coreNum;
+          separator = ",";
+        }
+      }
+      os << '}';
+    }
+  }
   
   return os;
 }
 
 
-bool loadInstructionsFromFiles(const std::filesystem::path& directory, const std::string& fileName, std::array<std::vector<Architecture::Instruction>, NUM_CORES>& instructionsByCore)  {
+bool loadInstructionsFromFile(const std::filesystem::path& filePath, std::vector<Architecture::Instruction>& instructions) {
+  ParseStats stats;
+  parseInstructionsFromFile(filePath.string(), instructions, stats);
+  return stats.success;
+}
+
+bool writeBinaryTrace(const std::filesystem::path& filePath, const std::vector<Architecture::Instruction>& instructions, bool coalesceCompute) {
+  std::vector<BinaryTraceRecord> records;
+  records.reserve(instructions.size());
+  auto appendRecord = [&records](const uint64_t value, const int numCoalesced, const INSTRUCTION_TYPE type) {
+    BinaryTraceRecord& record = records.emplace_back();
+    record.setValue(value);
+    record.numCoalesced = uint16_t(numCoalesced);
+    record.instType = uint8_t(type);
+  };
+  for (const Instruction& instruction : instructions) {
+    if (instruction.instType != COMPUTE) {
+      appendRecord(instruction.dataAddress, 1, instruction.instType);
+      continue;
+    }
+
+    // A compute instruction always takes at least 1 cycle, so a merged run takes the sum of each instruction's cycles
+    const uint32_t cycles = std::max(instruction.computeCycles, 1);
+    BinaryTraceRecord* last = records.empty() ? nullptr : &records.back();
+    if (coalesceCompute && last != nullptr && last->instType == COMPUTE
+        && last->getValue() + cycles <= uint64_t(std::numeric_limits<int>::max())
+        && uint32_t(last->numCoalesced) + instruction.numCoalesced <= std::numeric_limits<uint16_t>::max()) {
+      last->setValue(last->getValue() + cycles);
+      last->numCoalesced += instruction.numCoalesced;
+    } else {
+      appendRecord(cycles, instruction.numCoalesced, COMPUTE);
+    }
+  }
+
+  const uint16_t flags = coalesceCompute ? BINARY_TRACE_COALESCED_FLAG : 0;
+  if (std::any_of(records.begin(), records.end(), [](const BinaryTraceRecord& record) {return record.valueHigh != 0;})) {
+    return writeBinaryRecords(filePath, BINARY_TRACE_VERSION, flags, records);
+  }
+  std::vector<BinaryTraceRecord32> records32(records.size());
+  for (size_t recordIdx = 0; recordIdx < records.size(); ++recordIdx) {
+    records32[recordIdx] = {records[recordIdx].valueLow, records[recordIdx].numCoalesced, records[recordIdx].instType, 0};
+  }
+  return writeBinaryRecords(filePath, BINARY_TRACE_32_BIT_VERSION, flags, records32);
+}
+
+int countTraceFiles(const std::filesystem::path& directory, const std::string& fileName) {
+  int numFiles = 0;
+  for (;; ++numFiles) {
+    bool fromSidecar;
+    if (!std::filesystem::exists(resolveTracePath(directory, fileName, numFiles, fromSidecar))) {
+      return numFiles;
+    }
+  }
+}
+
+bool loadInstructionsFromFiles(const std::filesystem::path& directory, const std::string& fileName, const int numCores, std::vector<std::vector<Architecture::Instruction>>& instructionsByCore, bool writeSidecars)  {
   std::cout << "Loading Instructions...\n";
-  std::array<std::string, NUM_CORES>paths;
-  std::array<std::thread, NUM_CORES> loadThreads;
-  std::array<bool, NUM_CORES> successes;
-  successes.fill(false);
-  for (int coreNum = 0; coreNum < NUM_CORES; ++coreNum) {
-    std::filesystem::path filePath = directory / std::format("{}_{}.data", fileName, coreNum);
-    paths[coreNum] = filePath.string(); 
-    loadThreads[coreNum] = std::move(std::thread(parseInstructionsFromFile, paths[coreNum], std::ref(instructionsByCore[coreNum]), std::ref(successes[coreNum])));
+  instructionsByCore.resize(numCores);
+  std::vector<std::string> paths(numCores);
+  std::unique_ptr<bool[]> fromSidecar = std::make_unique<bool[]>(numCores);
+  std::vector<ParseStats> parseStats(numCores);
+  for (int coreNum = 0; coreNum < numCores; ++coreNum) {
+    paths[coreNum] = resolveTracePath(directory, fileName, coreNum, fromSidecar[coreNum]);
+  }
+
+  // Parse on at most one thread per hardware thread, each picking up the next unparsed trace
+  std::atomic<int> nextCoreNum = 0;
+  auto parseWorker = [&]() {
+    for (int coreNum = nextCoreNum++; coreNum < numCores; coreNum = nextCoreNum++) {
+      parseInstructionsFromFile(paths[coreNum], instructionsByCore[coreNum], parseStats[coreNum]);
+    }
+  };
+  const int numThreads = std::clamp<int>(std::thread::hardware_concurrency(), 1, numCores);
+  std::vector<std::thread> loadThreads;
+  for (int threadIdx = 0; threadIdx < numThreads; ++threadIdx) {
+    loadThreads.emplace_back(parseWorker);
+  }
+  for (std::thread& loadThread : loadThreads) {
+    loadThread.join();
   }
 
   bool success = true;
-  for (int coreNum = 0; coreNum < NUM_CORES; ++coreNum) {
-    loadThreads[coreNum].join();
-    if (successes[coreNum]) {
-      std::cout << "Core " << coreNum << " loaded " << instructionsByCore[coreNum].size() << " instructions from " << paths[coreNum] << '\n';
+  for (int coreNum = 0; coreNum < numCores; ++coreNum) {
+    if (parseStats[coreNum].success) {
+      const double megabytes = parseStats[coreNum].bytesParsed / (1024.0 * 1024.0);
+      std::cout << "Core " << coreNum << " loaded " << instructionsByCore[coreNum].size() << " instructions from " << paths[coreNum]
+                << std::format(" ({:.1f} MB/s)", megabytes / parseStats[coreNum].parseSeconds) << '\n';
+
+      if (writeSidecars && !fromSidecar[coreNum]) {
+        std::filesystem::path sidecarPath = paths[coreNum];
+        sidecarPath.replace_extension(BINARY_TRACE_EXTENSION);
+        if (writeBinaryTrace(sidecarPath, instructionsByCore[coreNum], true)) {
+          std::cout << "Core " << coreNum << " cached trace to " << sidecarPath.string() << '\n';
+        }
+      }
     }
     else {
       std::cout << "Core " << coreNum << " failed to load instructions from " << paths[coreNum] << '\n';
     }
-    success &= successes[coreNum];
+    success &= parseStats[coreNum].success;
+  }
+  return success;
+}
+
+InstructionStream::InstructionStream(const std::filesystem::path& filePath, size_t capacity)
+    : m_filePath(filePath.string()), m_ring(std::bit_ceil(std::max<size_t>(capacity, 2)), Instruction(COMPUTE, 0)), m_mask(m_ring.size() - 1) {
+  m_producerThread = std::thread(&InstructionStream::produce, this);
+}
+
+InstructionStream::~InstructionStream() {
+  m_stopRequested.store(true, std::memory_order_release);
+  m_producerThread.join();
+}
+
+bool InstructionStream::pop(Instruction& instruction) {
+  const size_t head = m_head.load(std::memory_order_relaxed);
+  while (head == m_tail.load(std::memory_order_acquire)) {
+    if (m_finished.load(std::memory_order_acquire) && head == m_tail.load(std::memory_order_acquire)) {
+      return false; // producer is done and everything it pushed has been consumed
+    }
+    std::this_thread::yield(); // parser is behind, wait for it to refill
+  }
+  instruction = m_ring[head & m_mask];
+  m_head.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+bool InstructionStream::push(INSTRUCTION_TYPE type, uint64_t value, int numCoalesced) {
+  const size_t tail = m_tail.load(std::memory_order_relaxed);
+  while (tail - m_head.load(std::memory_order_acquire) == m_ring.size()) {
+    if (m_stopRequested.load(std::memory_order_acquire)) {
+      return false; // consumer is gone, stop parsing
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(100)); // ring is full, sleep rather than spin so many producers do not starve the simulation
+  }
+  m_ring[tail & m_mask] = Instruction(type, value, numCoalesced);
+  m_tail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+void InstructionStream::produce() {
+  MappedFile mappedFile(m_filePath);
+  bool success = mappedFile.isMapped();
+  if (!success) {
+    std::fprintf(stderr, "Failed to open file %s\n", m_filePath.c_str());
+  } else {
+    auto emit = [this](INSTRUCTION_TYPE type, uint64_t value, int numCoalesced) {
+      return push(type, value, numCoalesced);
+    };
+    success = isBinaryTrace(mappedFile) ? parseBinaryTrace(mappedFile, emit) : parseTextTrace(mappedFile, emit);
+    if (!success && !m_stopRequested.load(std::memory_order_acquire)) {
+      std::fprintf(stderr, "Failed to parse file %s\n", m_filePath.c_str());
+    }
+  }
+  m_failed.store(!success && !m_stopRequested.load(std::memory_order_acquire), std::memory_order_release);
+  m_finished.store(true, std::memory_order_release);
+}
+
+bool openInstructionStreams(const std::filesystem::path& directory, const std::string& fileName, const int numCores, std::vector<std::unique_ptr<InstructionStream>>& streamsByCore, size_t capacity) {
+  std::cout << "Streaming Instructions...\n";
+  streamsByCore.resize(numCores);
+  bool success = true;
+  for (int coreNum = 0; coreNum < numCores; ++coreNum) {
+    bool fromSidecar;
+    std::string path = resolveTracePath(directory, fileName, coreNum, fromSidecar);
+    if (!std::filesystem::exists(path)) {
+      std::cout << "Core " << coreNum << " failed to find instructions at " << path << '\n';
+      success = false;
+      continue;
+    }
+    streamsByCore[coreNum] = std::make_unique<InstructionStream>(path, capacity);
+    std::cout << "Core " << coreNum << " streaming instructions from " << path << '\n';
   }
   return success;
 }
@@ -1,61 +1,258 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
 #include <cstdint>
 #include <filesystem>
+#include <memory>
 #include <ostream>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace Architecture {
 
-constexpr int ADDRESS_SPACE_BIT_SIZE = 32;
+constexpr int ADDRESS_SPACE_BIT_SIZE = 64;
 constexpr int WORD_SIZE_BYTES = 4;
 constexpr char DEFAULT_DATA_FOLDER[] = "data";
-constexpr int NUM_CORES = 4;
 
+// Cycle counter shared by the CPU and memory system of a single simulation
 class GlobalCycleCounter {   
 public:
-  static void initialiseCounter() {counter = 0;}
-  static void incrementCounter() {++counter;}
-  static int getCounter() {return counter;}
+  void initialiseCounter() {counter = 0;}
+  void incrementCounter() {++counter;}
+  void advanceCounter(const long long cycles) {counter += cycles;}
+  long long getCounter() const {return counter;}
 
-  GlobalCycleCounter() = delete;
 private:
-  static int counter;
+  long long counter = 0;
 };
 
+// Where a load or store was served from, for the latency histograms
+enum REQUEST_SOURCE : uint8_t {
+  L1_HIT = 0,
+  CACHE_TO_CACHE = 1, // bus transaction served with a block from another cache
+  MEMORY = 2 // any other bus transaction, filled from the L2 or memory, or an upgrade needing no block
+};
+constexpr int NUM_REQUEST_SOURCES = 3;
+
+// Log linear histogram of non negative values, exact below 2^SUB_BUCKET_BITS and within 1 part in 2^SUB_BUCKET_BITS
+// above, like an HDR histogram. Buckets are fixed so recording never allocates
+class LatencyHistogram {
+public:
+  void record(const long long value, const long long count = 1) {
+    m_counts[getBucketIdx(value)] += count;
+    m_max = std::max(m_max, value);
+  }
+  void clear() {*this = LatencyHistogram();}
+  long long getNumSamples() const;
+  long long getMax() const {return m_max;}
+  // Highest value of the bucket holding the percentile, capped at the maximum. 0 if nothing was recorded
+  long long getPercentile(const double percentile) const;
+
+private:
+  static constexpr int SUB_BUCKET_BITS = 4;
+  static constexpr int NUM_BUCKETS = (63 - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+  static int getBucketIdx(const long long value) {
+    if (value < (1LL << SUB_BUCKET_BITS)) return int(value);
+    const int shift = 63 - std::countl_zero(uint64_t(value)) - SUB_BUCKET_BITS;
+    return ((shift + 1) << SUB_BUCKET_BITS) + int(value >> shift) - (1 << SUB_BUCKET_BITS);
+  }
+
+  std::array<long long, NUM_BUCKETS> m_counts{};
+  long long m_max = 0;
+};
+
+// A block's coherence activity from the sharing profiler
+struct SharedLineReport {
+  uint64_t blockAddress;
+  uint64_t sharers; // bit per core that accessed the block
+  long long numInvalidations;
+  long long numUpdates;
+  long long numPingPongs; // stores moving ownership away from the previous writer
+  long long numTrueSharing; // invalidations and updates of copies whose core had accessed the written word
+  long long numFalseSharing;
+};
+
+// Counters of a single simulation
 struct GlobalReport {
-  static int overallExecutionCycles;
-  static std::array<int, Architecture::NUM_CORES> numComputeInstructions;
-  static std::array<int, Architecture::NUM_CORES> computeCycles;
-  static std::array<int, Architecture::NUM_CORES> numLoadStoreInstructions;
-  static std::array<int, Architecture::NUM_CORES> idleCycles;
-  static std::array<int, Architecture::NUM_CORES> numCacheHits;
-  static std::array<int, Architecture::NUM_CORES> numCacheMisses;
-  static int busDataTrafficBytes;
-  static int busInvalidationsOrUpdates;
-  static int numPrivateAccess;
-  static int numSharedAccess;
-
-  static void clearReport();
-};
-std::ostream& printGlobalReport(std::ostream& os);
-
-enum INSTRUCTION_TYPE {
+  long long overallExecutionCycles = 0;
+  std::vector<long long> numComputeInstructions;
+  std::vector<long long> computeCycles;
+  std::vector<long long> numLoadStoreInstructions;
+  std::vector<long long> idleCycles;
+  std::vector<long long> numCacheHits;
+  std::vector<long long> numCacheMisses;
+  long long busDataTrafficBytes = 0;
+  long long busInvalidationsOrUpdates = 0;
+  long long numPrivateAccess = 0;
+  long long numSharedAccess = 0;
+  long long numCacheToCacheTransfers = 0; // demand bus transactions served with a block from another cache
+  long long cacheToCacheTransferCycles = 0; // summed over those transactions, from being processed to completing
+  bool snoopFilterEnabled = false; // only report snoop filter counters if enabled
+  long long numSnoopsAvoided = 0; // other cores not snooped compared to broadcasting every bus transaction
+  int splitBusMemorySlots = 0; // only report split bus counters if non zero
+  long long numMemorySlotStallCycles = 0; // cycles a request held the bus waiting for a free memory slot
+  long long numInFlightBlockStallCycles = 0; // cycles the bus waited for an in flight transaction to the same block
+  int numMshrs = 0; // only report memory level parallelism if non blocking caches are enabled
+  std::vector<long long> outstandingMissCycles; // cycles with at least one miss outstanding
+  std::vector<long long> outstandingMissSum; // outstanding misses summed over those cycles
+  int storeBufferDepth = 0; // only report store buffer counters if non zero
+  std::vector<long long> storeBufferOccupancySum; // buffered stores summed over every cycle
+  std::vector<int> storeBufferMaxOccupancy;
+  std::vector<long long> storeBufferFullStallCycles; // cycles stores waited for space in the store buffer
+  std::vector<long long> numForwardedLoads; // loads served from the store buffer
+  int l2CacheSize = 0; // only report L2 counters if non zero
+  long long numL2Hits = 0; // L1 fills from the L2 instead of memory
+  long long numL2Misses = 0;
+  long long numL2BackInvalidations = 0; // L1 lines invalidated by an inclusive L2 evicting their block
+  long long memoryTrafficBytes = 0; // blocks read from or written back to memory
+  long long l1MemoryTrafficBytes = 0; // memory traffic without an L2, every L1 fill from or write back to memory
+  bool prefetchingEnabled = false; // only report prefetch counters if enabled
+  long long numPrefetchesIssued = 0;
+  long long numUsefulPrefetches = 0; // prefetched blocks the core accessed before they were evicted or invalidated
+  long long numLatePrefetches = 0; // issued prefetches the core needed before they completed
+  long long numDroppedPrefetches = 0; // queued prefetches cancelled because the block was fetched on demand first
+  long long prefetchBusDataTrafficBytes = 0; // part of the bus data traffic spent on prefetches
+  int hybridUpdateThreshold = 0; // only report hybrid protocol counters if non zero
+  long long numHybridUpdateLines = 0; // written shared blocks whose other copies were only ever updated
+  long long numHybridInvalidateLines = 0; // written shared blocks whose other copies were only ever invalidated
+  long long numHybridSwitchedLines = 0; // written shared blocks that ran in both modes
+  long long numHybridUpdatedCopies = 0;
+  long long numHybridInvalidatedCopies = 0;
+  int meshWidth = 0; // only report mesh counters if non zero
+  int meshHeight = 0;
+  std::vector<long long> meshLinkBusyCycles; // cycles each mesh link carried a message, indexed node * 4 + port (east, west, north, south)
+  long long numMeshMessages = 0;
+  long long meshMessageHops = 0; // links crossed summed over every message
+  int dramChannels = 0; // only report DRAM counters if non zero
+  int dramBanks = 0; // per channel
+  long long numDramReads = 0;
+  long long numDramWrites = 0; // write backs drained from the write buffer to the banks
+  long long numDramRowHits = 0; // accesses to the open row of their bank
+  long long numDramRowMisses = 0; // accesses to a bank with no open row
+  long long numDramRowConflicts = 0; // accesses closing another open row first
+  long long numDramWriteBufferForwards = 0; // reads served from a write back still in the write buffer
+  long long numDramWriteBufferFullStalls = 0; // write backs that waited for space in the write buffer
+  long long dramReadLatencyCycles = 0; // summed over every read, from reaching the controller to its data returning
+  // Cycles from issue through completion of each core's loads and stores, by where they were served
+  std::vector<std::array<LatencyHistogram, NUM_REQUEST_SOURCES>> requestLatencyByCore;
+  LatencyHistogram busQueueDepth; // transactions in the bus queue, including any on an atomic bus, sampled every cycle
+  int sharingProfileTopLines = 0; // only report the sharing profile if non zero
+  long long numProfiledLines = 0; // blocks accessed by any core
+  long long numSharedLines = 0; // blocks accessed by more than one core
+  long long numTrueSharingEvents = 0;
+  long long numFalseSharingEvents = 0;
+  long long numOwnershipPingPongs = 0;
+  std::vector<SharedLineReport> hottestSharedLines; // most invalidated or updated first
+  long long mesiBusDataTrafficBytes = -1; // the same run under pure MESI and pure Dragon, -1 if not simulated
+  long long dragonBusDataTrafficBytes = -1;
+
+  void clearReport(const int numCores);
+  int getNumCores() const {return numComputeInstructions.size();}
+};
+std::ostream& printGlobalReport(std::ostream& os, const GlobalReport& report);
+
+enum INSTRUCTION_TYPE : uint8_t {
   LOAD = 0,
   STORE = 1,
   COMPUTE = 2
 };
 
+// Ordered widest first so the 64 bit address still packs into 16 bytes
 struct Instruction {
-  const INSTRUCTION_TYPE instType;
-  const uint32_t dataAddress; // For Load/Store instructions
-  const int computeCycles; // For compute instructions
-  int executionCycles = 0;
+  uint64_t dataAddress; // For Load/Store instructions
+  int computeCycles; // For compute instructions
+  uint16_t numCoalesced; // For compute instructions, number of trace instructions merged into this one
+  INSTRUCTION_TYPE instType;
+
+  Instruction(INSTRUCTION_TYPE type, uint64_t value, int numCoalesced = 1) : dataAddress((type == LOAD || type == STORE) ? value : 0), computeCycles((type == COMPUTE) ? int(value) : 0), numCoalesced((type == COMPUTE) ? numCoalesced : 1), instType(type) {}
+};
+static_assert(sizeof(Instruction) == 16);
+
+// Binary trace format, a header followed by numRecords fixed width records in host (little endian) byte order.
+// Traces whose values all fit in 32 bits are written with the smaller 32 bit records
+constexpr char BINARY_TRACE_MAGIC[] = "CTRC";
+constexpr char BINARY_TRACE_EXTENSION[] = ".bin";
+constexpr uint16_t BINARY_TRACE_VERSION = 3;
+constexpr uint16_t BINARY_TRACE_32_BIT_VERSION = 1;
+constexpr uint16_t BINARY_TRACE_COALESCED_FLAG = 1; // runs of compute instructions are merged into one record
+
+struct BinaryTraceHeader {
+  char magic[4];
+  uint16_t version;
+  uint16_t flags;
+  uint64_t numRecords;
+};
+static_assert(sizeof(BinaryTraceHeader) == 16);
+
+// The 64 bit value is split in two so the record packs into 12 bytes
+struct BinaryTraceRecord {
+  uint32_t valueLow; // address for load/store, total cycles for compute
+  uint32_t valueHigh;
+  uint16_t numCoalesced; // number of compute instructions merged into this record
+  uint8_t instType;
+  uint8_t reserved;
+
+  uint64_t getValue() const {return uint64_t(valueHigh) << 32 | valueLow;}
+  void setValue(const uint64_t value) {valueLow = uint32_t(value); valueHigh = uint32_t(value >> 32);}
+};
+static_assert(sizeof(BinaryTraceRecord) == 12);
+
+struct BinaryTraceRecord32 {
+  uint32_t value;
+  uint16_t numCoalesced;
+  uint8_t instType;
+  uint8_t reserved;
+
+  uint64_t getValue() const {return value;}
+};
+static_assert(sizeof(BinaryTraceRecord32) == 8);
+
+// Loads a single text or binary trace, detected from its contents
+bool loadInstructionsFromFile(const std::filesystem::path& filePath, std::vector<Architecture::Instruction>& instructions);
+bool writeBinaryTrace(const std::filesystem::path& filePath, const std::vector<Architecture::Instruction>& instructions, bool coalesceCompute);
+
+// Number of consecutive {fileName}_{core} text or binary traces starting from core 0
+int countTraceFiles(const std::filesystem::path& directory, const std::string& fileName);
+
+// Loads {fileName}_{core}.data for each of numCores cores, preferring a {fileName}_{core}.bin sidecar newer than the text trace
+bool loadInstructionsFromFiles(const std::filesystem::path& directory, const std::string& fileName, const int numCores, std::vector<std::vector<Architecture::Instruction>>& instructionsByCore, bool writeSidecars = false);
+
+// Bounded single producer single consumer ring of instructions, refilled by a background thread parsing the trace
+class InstructionStream {
+public:
+  static constexpr size_t DEFAULT_CAPACITY = 1 << 16;
+
+  // Capacity is rounded up to a power of two
+  InstructionStream(const std::filesystem::path& filePath, size_t capacity = DEFAULT_CAPACITY);
+  ~InstructionStream();
+  InstructionStream(const InstructionStream&) = delete;
+  InstructionStream& operator=(const InstructionStream&) = delete;
+
+  // Blocks until the next instruction is parsed, returns false once the trace is exhausted or failed to parse
+  bool pop(Instruction& instruction);
+  bool hasFailed() const {return m_failed.load(std::memory_order_acquire);}
+  const std::string& getFilePath() const {return m_filePath;}
+
+private:
+  void produce();
+  bool push(INSTRUCTION_TYPE type, uint64_t value, int numCoalesced);
 
-  Instruction(INSTRUCTION_TYPE type, int value) : instType(type), dataAddress((type == LOAD || type == STORE) ? value : 0), computeCycles((type == COMPUTE) ? value : 0) {}
+  const std::string m_filePath;
+  std::vector<Instruction> m_ring;
+  const size_t m_mask;
+  alignas(64) std::atomic<size_t> m_head = 0; // next slot to pop, only written by the consumer
+  alignas(64) std::atomic<size_t> m_tail = 0; // next slot to push, only written by the producer
+  std::atomic<bool> m_finished = false;
+  std::atomic<bool> m_failed = false;
+  std::atomic<bool> m_stopRequested = false;
+  std::thread m_producerThread;
 };
 
-bool loadInstructionsFromFiles(const std::filesystem::path& directory, const std::string& fileName, std::array<std::vector<Architecture::Instruction>, NUM_CORES>& instructionsByCore);
+// Opens a stream per core over the same files loadInstructionsFromFiles would load
+bool openInstructionStreams(const std::filesystem::path& directory, const std::string& fileName, const int numCores, std::vector<std::unique_ptr<InstructionStream>>& streamsByCore, size_t capacity);
 } // namespce
\ No newline at end of file
@@ -1,27 +1,66 @@
 #include "cache.h"
 #include "architecture.h"
 
+#include <algorithm>
+#include <bit>
 #include <cmath>
 #include <cstdio>
 #include <limits>
 
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+
+namespace {
+// Set scans compare several ways at once, preferring AVX2 and falling back to SSE2 then scalar
+#if defined(__AVX2__)
+constexpr int SIMD_WAYS = 4;
+#elif defined(__SSE2__)
+constexpr int SIMD_WAYS = 2;
+#else
+constexpr int SIMD_WAYS = 1;
+#endif
+
+// Bit mask of which of the SIMD_WAYS tags starting at tags are equal to tag, bit 0 for tags[0]
+inline uint32_t matchTags(const uint64_t* tags, const uint64_t tag) {
+#if defined(__AVX2__)
+  const __m256i matches = _mm256_cmpeq_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(tags)), _mm256_set1_epi64x(tag));
+  return _mm256_movemask_pd(_mm256_castsi256_pd(matches));
+#elif defined(__SSE2__)
+  // SSE2 has no 64 bit compare, a tag matches if both of its halves do
+  const __m128i halfMatches = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(tags)), _mm_set1_epi64x(tag));
+  const __m128i matches = _mm_and_si128(halfMatches, _mm_shuffle_epi32(halfMatches, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_movemask_pd(_mm_castsi128_pd(matches));
+#else
+  return *tags == tag;
+#endif
+}
 
-namespace Cache {
+// Index of the first valid way holding tag, or -1
+int findValidTagInSet(const uint64_t* tags, const Cache::CACHELINE_STATE* states, const int associativity, const uint64_t tag) {
+  int blockIdx = 0;
+  for (; blockIdx + SIMD_WAYS <= associativity; blockIdx += SIMD_WAYS) {
+    // invalidated lines keep their tag, so check the state of each match in way order
+    for (uint32_t matches = matchTags(tags + blockIdx, tag); matches != 0; matches &= matches - 1) {
+      const int matchIdx = blockIdx + std::countr_zero(matches);
+      if (states[matchIdx] != Cache::INVALID) return matchIdx;
+    }
+  }
+  for (; blockIdx < associativity; ++blockIdx) {
+    if (tags[blockIdx] == tag && states[blockIdx] != Cache::INVALID) return blockIdx;
+  }
+  return -1;
+}
 
-// Define static variables
-COHERENCE_PROTOCOL protocol = MESI;
-int MemorySystem::cacheSize = 0;
-int MemorySystem::associativity = 0;
-int MemorySystem::blockSize = 0;
-int MemorySystem::numBlocks = 0;
-int MemorySystem::numSets = 0;
-int MemorySystem::wordsPerBlock = 0;
-int MemorySystem::blockOffsetRShiftBits = 0;
-uint32_t MemorySystem::blockOffsetMask = 0;
-int MemorySystem::setIdxRShiftBits = 0;
-uint32_t MemorySystem::setIdxMask = 0;
-int MemorySystem::tagRShiftBits = 0;
-uint32_t MemorySystem::tagMask = 0;
+// Index of the first invalid way, or -1
+int findInvalidBlockInSet(const Cache::CACHELINE_STATE* states, const int associativity) {
+  const Cache::CACHELINE_STATE* invalidState = std::find(states, states + associativity, Cache::INVALID);
+  return (invalidState != states + associativity) ? invalidState - states : -1;
+}
+} // anonymous namespace
+
+namespace Cache {
 
 std::string toString(CACHELINE_STATE state) {
   switch (state) {
@@ -39,15 +78,49 @@ std::string toString(CACHELINE_STATE state) {
       return "Shared Modified";
     case OWNED:
       return "Owned";
+    case FORWARD:
+      return "Forward";
   }
   return "Unknown State";
 }
 
+std::string toString(L2_POLICY policy) {
+  switch (policy) {
+    case L2_INCLUSIVE:
+      return L2_INCLUSIVE_STRING;
+    case L2_NON_INCLUSIVE:
+      return L2_NON_INCLUSIVE_STRING;
+    case L2_EXCLUSIVE:
+      return L2_EXCLUSIVE_STRING;
+  }
+  return "Unknown Policy";
+}
+
+std::string toString(COHERENCE_PROTOCOL protocol) {
+  switch (protocol) {
+    case MESI:
+      return MESI_STRING;
+    case DRAGON:
+      return DRAGON_STRING;
+    case MOESI:
+      return MOESI_STRING;
+    case HYBRID:
+      return HYBRID_STRING;
+    case MESIF:
+      return MESIF_STRING;
+    case MSI:
+      return MSI_STRING;
+    case DIRECTORY:
+      return DIRECTORY_STRING;
+  }
+  return "Unknown Protocol";
+}
+
 
-bool MemorySystem::initialiseStaticCacheVariables(const int cacheSize, const int associativity, const int blockSize) {
-  MemorySystem::cacheSize = cacheSize;
-  MemorySystem::associativity = associativity;
-  MemorySystem::blockSize = blockSize;
+bool CacheGeometry::initialise(const int cacheSize, const int associativity, const int blockSize) {
+  this->cacheSize = cacheSize;
+  this->associativity = associativity;
+  this->blockSize = blockSize;
   wordsPerBlock = blockSize / Architecture::WORD_SIZE_BYTES;
 
   // Calculate cache Params
@@ -65,191 +138,927 @@ bool MemorySystem::initialiseStaticCacheVariables(const int cacheSize, const int
 
   // Create Block Offset Mask
   const int numBlockOffsetBits = std::log2(blockSize);
-  blockOffsetMask = 0;
-  for (int i = 0; i < numBlockOffsetBits; ++i) {
-    blockOffsetMask += std::pow(2, i);
-  }
+  blockOffsetMask = (uint64_t(1) << numBlockOffsetBits) - 1;
   blockOffsetRShiftBits = 0;
 
   // Create Set Idx Mask
   const int numSetIndexBits = std::log2(numSets);
-  setIdxMask = 0;
-  for (int i = numBlockOffsetBits; i < numBlockOffsetBits + numSetIndexBits; ++i) {
-    setIdxMask += std::pow(2, i);
-  }
+  setIdxMask = ((uint64_t(1) << numSetIndexBits) - 1) << numBlockOffsetBits;
   setIdxRShiftBits = numBlockOffsetBits;
 
 
-  // Create Tag Mask
-  tagMask = 0;
-  for (int i = numBlockOffsetBits + numSetIndexBits; i < Architecture::ADDRESS_SPACE_BIT_SIZE; ++i) {
-    tagMask += std::pow(2, i);
-  }
+  // Create Tag Mask, every bit of the address space above the set index
+  tagMask = ~(blockOffsetMask | setIdxMask);
   tagRShiftBits = numBlockOffsetBits + numSetIndexBits;
 
   return true;
 }
 
-inline uint32_t MemorySystem::getBlockOffset(const uint32_t address) {
-  return (address & blockOffsetMask) >> blockOffsetRShiftBits;
+bool L2Config::isCompatible(const CacheGeometry& l1Geometry) const {
+  if (!isEnabled()) {
+    return true;
+  }
+  if (geometry.blockSize % l1Geometry.blockSize != 0) {
+    std::fprintf(stderr, "Error: L2 block size(%d) must be a multiple of the L1 block size(%d)\n", geometry.blockSize, l1Geometry.blockSize);
+    return false;
+  }
+  if (policy == L2_EXCLUSIVE && geometry.blockSize != l1Geometry.blockSize) {
+    std::fprintf(stderr, "Error: Exclusive L2 block size(%d) must equal the L1 block size(%d)\n", geometry.blockSize, l1Geometry.blockSize);
+    return false;
+  }
+  return true;
+}
+
+SnoopFilter::SnoopFilter(const int numCores)
+    : m_wordsPerEntry((numCores + 63) / 64), m_blockAddresses(INITIAL_SLOTS, EMPTY_SLOT), m_presenceBits(INITIAL_SLOTS * m_wordsPerEntry, 0),
+      m_slotShift(64 - std::countr_zero(INITIAL_SLOTS)) {}
+
+void SnoopFilter::addSharer(const uint64_t blockAddress, const int coreNum) {
+  size_t slotIdx = findSlot(blockAddress);
+  if (m_blockAddresses[slotIdx] == EMPTY_SLOT) { // new entry
+    if (2 * (m_numUsedSlots + 1) > m_blockAddresses.size()) {
+      grow();
+      slotIdx = findSlot(blockAddress);
+    }
+    ++m_numUsedSlots;
+    m_blockAddresses[slotIdx] = blockAddress;
+  }
+  m_presenceBits[slotIdx * m_wordsPerEntry + coreNum / 64] |= uint64_t(1) << (coreNum % 64);
+}
+
+void SnoopFilter::removeSharer(const uint64_t blockAddress, const int coreNum) {
+  const size_t slotIdx = findSlot(blockAddress);
+  if (m_blockAddresses[slotIdx] == EMPTY_SLOT) return;
+
+  uint64_t* bits = &m_presenceBits[slotIdx * m_wordsPerEntry];
+  bits[coreNum / 64] &= ~(uint64_t(1) << (coreNum % 64));
+  if (std::all_of(bits, bits + m_wordsPerEntry, [](uint64_t word) {return word == 0;})) { // no sharers left, free the entry
+    eraseSlot(slotIdx);
+  }
+}
+
+size_t SnoopFilter::findSlot(const uint64_t blockAddress) const {
+  const size_t mask = m_blockAddresses.size() - 1;
+  size_t slotIdx = (blockAddress * 0x9E3779B97F4A7C15ull) >> m_slotShift;
+  while (m_blockAddresses[slotIdx] != blockAddress && m_blockAddresses[slotIdx] != EMPTY_SLOT) {
+    slotIdx = (slotIdx + 1) & mask;
+  }
+  return slotIdx;
 }
 
-inline uint32_t MemorySystem::getSetIdx(const uint32_t address) {
-  return (address & setIdxMask) >> setIdxRShiftBits;
+void SnoopFilter::eraseSlot(size_t slotIdx) {
+  const size_t mask = m_blockAddresses.size() - 1;
+  for (size_t nextIdx = (slotIdx + 1) & mask; m_blockAddresses[nextIdx] != EMPTY_SLOT; nextIdx = (nextIdx + 1) & mask) {
+    // An entry can fill the hole only if the hole lies on its probe, between its home slot and where it sits
+    const size_t homeIdx = (m_blockAddresses[nextIdx] * 0x9E3779B97F4A7C15ull) >> m_slotShift;
+    if (((nextIdx - homeIdx) & mask) < ((nextIdx - slotIdx) & mask)) continue;
 
+    m_blockAddresses[slotIdx] = m_blockAddresses[nextIdx];
+    std::copy_n(&m_presenceBits[nextIdx * m_wordsPerEntry], m_wordsPerEntry, &m_presenceBits[slotIdx * m_wordsPerEntry]);
+    slotIdx = nextIdx;
+  }
+  m_blockAddresses[slotIdx] = EMPTY_SLOT;
+  std::fill_n(&m_presenceBits[slotIdx * m_wordsPerEntry], m_wordsPerEntry, 0);
+  --m_numUsedSlots;
 }
 
-inline uint32_t MemorySystem::getTag(const uint32_t address) {
-  return (address & tagMask) >> tagRShiftBits;
+void SnoopFilter::grow() {
+  std::vector<uint64_t> oldBlockAddresses(m_blockAddresses.size() * 2, EMPTY_SLOT);
+  std::vector<uint64_t> oldPresenceBits(m_presenceBits.size() * 2, 0);
+  oldBlockAddresses.swap(m_blockAddresses);
+  oldPresenceBits.swap(m_presenceBits);
+  --m_slotShift;
+  for (size_t oldIdx = 0; oldIdx < oldBlockAddresses.size(); ++oldIdx) {
+    if (oldBlockAddresses[oldIdx] == EMPTY_SLOT) continue;
+    const size_t slotIdx = findSlot(oldBlockAddresses[oldIdx]);
+    m_blockAddresses[slotIdx] = oldBlockAddresses[oldIdx];
+    std::copy_n(&oldPresenceBits[oldIdx * m_wordsPerEntry], m_wordsPerEntry, &m_presenceBits[slotIdx * m_wordsPerEntry]);
+  }
 }
 
-MemorySystem::MemorySystem() {
+void SnoopFilter::getSharers(const uint64_t blockAddress, const int excludedCoreNum, std::vector<int>& sharers) const {
+  const size_t slotIdx = findSlot(blockAddress);
+  if (m_blockAddresses[slotIdx] == EMPTY_SLOT) return;
+
+  const uint64_t* bits = &m_presenceBits[slotIdx * m_wordsPerEntry];
+  for (int wordIdx = 0; wordIdx < m_wordsPerEntry; ++wordIdx) {
+    for (uint64_t word = bits[wordIdx]; word != 0; word &= word - 1) { // visit set bits from lowest to highest
+      const int coreNum = wordIdx * 64 + std::countr_zero(word);
+      if (coreNum != excludedCoreNum) sharers.push_back(coreNum);
+    }
+  }
+}
+
+CompletionWheel::CompletionWheel(const int expectedPerTick) {
+  for (std::vector<MemoryRequest>& slot : m_slots) {
+    slot.reserve(expectedPerTick);
+  }
+}
+
+void CompletionWheel::schedule(const MemoryRequest& request, const int cycles) {
+  m_slots[(m_currSlot + cycles - 1) & (NUM_SLOTS - 1)].push_back(request);
+  ++m_numScheduled;
+}
+
+void CompletionWheel::advance(std::vector<MemoryRequest>& completedMemoryRequests) {
+  std::vector<MemoryRequest>& slot = m_slots[m_currSlot];
+  completedMemoryRequests.insert(completedMemoryRequests.end(), slot.begin(), slot.end());
+  m_numScheduled -= slot.size();
+  slot.clear();
+  m_currSlot = (m_currSlot + 1) & (NUM_SLOTS - 1);
+}
+
+int CompletionWheel::cyclesUntilNextCompletion() const {
+  if (m_numScheduled == 0) {
+    return std::numeric_limits<int>::max();
+  }
+  int cycles = 0;
+  while (m_slots[(m_currSlot + cycles) & (NUM_SLOTS - 1)].empty()) {
+    ++cycles;
+  }
+  return cycles;
+}
+
+MemorySystem::MemorySystem(const CacheGeometry& geometry, const int numCores, const MemorySystemConfig& config, Architecture::GlobalReport& report, const Architecture::GlobalCycleCounter& cycleCounter)
+    : m_geometry(geometry), m_report(report), m_cycleCounter(cycleCounter), m_numCores(numCores), m_executingNonBusRequests(numCores), m_maxOutstandingMemoryTransactions(config.maxOutstandingMemoryTransactions), m_numMshrs(config.numMshrs),
+      m_l2Config(config.l2), m_l2PresenceWordsPerLine(config.l2.useAsSnoopFilter ? (numCores + 63) / 64 : 0) {
+  if (config.useSnoopFilter) {
+    m_snoopFilterPtr = std::make_unique<SnoopFilter>(numCores);
+  }
+  m_report.snoopFilterEnabled = config.useSnoopFilter || config.l2.useAsSnoopFilter;
+  m_report.splitBusMemorySlots = config.maxOutstandingMemoryTransactions;
+  m_report.numMshrs = config.numMshrs;
+  m_mshrsByCore.resize(numCores);
   // Initialise caches to the right size
-  for (std::vector<std::vector<CacheLine>>& cache : m_l1Caches) {
-    cache = std::vector<std::vector<CacheLine>>(numSets, std::vector<CacheLine>(associativity));
+  m_l1Caches.assign(numCores, L1Cache(m_geometry.numBlocks));
+  for (int coreNum = 0; coreNum < numCores; ++coreNum) {
+    m_replacementByCore.push_back(Replacement::makeReplacementPolicy(config.replacementPolicy, m_geometry.numSets, m_geometry.associativity));
+  }
+  m_numSnoopHits.assign(numCores, 0);
+  m_report.prefetchingEnabled = config.prefetcher.type != Prefetch::NONE;
+  if (config.prefetcher.type != Prefetch::NONE) {
+    for (int coreNum = 0; coreNum < numCores; ++coreNum) {
+      m_prefetchersByCore.push_back(Prefetch::makePrefetcher(config.prefetcher, m_geometry.blockSize));
+    }
+    m_prefetchedBlocksByCore.resize(numCores);
+  }
+  if (!config.quiet) {
+    printf("Initialised %zu L1 Cache(s) of %d bytes with %d associativity, %d blocks of %d bytes or %d words, grouped into %d sets, with %s replacement.\n", m_l1Caches.size(), m_geometry.cacheSize, m_geometry.associativity, m_geometry.numBlocks, m_geometry.blockSize, m_geometry.wordsPerBlock, m_geometry.numSets, Replacement::toString(config.replacementPolicy).c_str());
+  }
+
+  m_report.l2CacheSize = m_l2Config.geometry.cacheSize;
+  if (m_l2Config.isEnabled()) {
+    const CacheGeometry& l2Geometry = m_l2Config.geometry;
+    m_l2CachePtr = std::make_unique<L1Cache>(l2Geometry.numBlocks);
+    m_l2ReplacementPtr = Replacement::makeReplacementPolicy(config.replacementPolicy, l2Geometry.numSets, l2Geometry.associativity);
+    m_l2PresenceBits.assign(size_t(l2Geometry.numBlocks) * m_l2PresenceWordsPerLine, 0);
+    if (!config.quiet) {
+      printf("Initialised a shared %s L2 Cache of %d bytes with %d associativity, %d blocks of %d bytes, grouped into %d sets, hitting in %d cycles.\n", toString(m_l2Config.policy).c_str(), l2Geometry.cacheSize, l2Geometry.associativity, l2Geometry.numBlocks, l2Geometry.blockSize, l2Geometry.numSets, m_l2Config.hitCycles);
+    }
+  }
+  if (config.dram.isEnabled()) {
+    const Dram::DramConfig& dram = config.dram;
+    m_dramPtr = std::make_unique<Dram::DramController>(dram, m_report);
+    if (!config.quiet) {
+      printf("Initialised a memory controller for %d DRAM channel(s) of %d banks with %d byte rows, taking %d/%d/%d cycles on a row hit/miss/conflict, and a %d entry write buffer.\n", dram.numChannels, dram.numBanks, dram.rowBytes, dram.rowHitCycles, dram.rowMissCycles, dram.rowConflictCycles, dram.writeBufferEntries);
+    }
+  }
+  if (config.sharingProfileTopLines > 0) {
+    m_sharingProfilerPtr = std::make_unique<Sharing::SharingProfiler>(numCores, m_geometry.numBlocks, m_geometry.blockSize, config.sharingProfileTopLines);
   }
-  printf("Initialised %zu L1 Cache(s) of %d bytes with %d associativity, %d blocks of %d bytes or %d words, grouped into %d sets.\n", m_l1Caches.size(), cacheSize, associativity, numBlocks, blockSize, wordsPerBlock, numSets);
 }
 
+template <typename Protocol>
 void MemorySystem::tickMemorySystem(const std::vector<MemoryRequest>& incomingMemoryRequests, std::vector<MemoryRequest>& completedMemoryRequests) {
   // Handle incoming requests
   for (const auto& request : incomingMemoryRequests) {
-    handleIncomingRequest(request);
+    acceptRequest<Protocol>(request);
+  }
+  for (int coreNum = 0; coreNum < m_mshrsByCore.size() && m_numMshrs > 0; ++coreNum) {
+    if (!m_mshrsByCore[coreNum].empty()) {
+      ++m_report.outstandingMissCycles[coreNum];
+      m_report.outstandingMissSum[coreNum] += m_mshrsByCore[coreNum].size();
+    }
   }
 
   // Process Executing Non Bus Memory Requests
-  if (!m_executingNonBusRequests.empty()) {
-    std::vector<std::pair<MemoryRequest, int>> newExecuting;
-    for (int i = 0; i < m_executingNonBusRequests.size(); ++i) {
-      auto& [request, remainingCycles] = m_executingNonBusRequests[i];
-      --remainingCycles;
-      if (remainingCycles <= 0) {
-        completedMemoryRequests.push_back(request);
-      } else {
-        newExecuting.emplace_back(request, remainingCycles);
-      }
-    }
-    m_executingNonBusRequests = std::move(newExecuting); // override with new list
+  m_executingNonBusRequests.advance(completedMemoryRequests);
+
+  if (std::is_same_v<Protocol, MemorySystem> && !m_usesBus) { // the protocols specialised here all run on the bus
+    tickInterconnect(completedMemoryRequests);
+    m_report.busQueueDepth.record(countQueuedTransactions());
+  } else {
+    tickBus<Protocol>(completedMemoryRequests);
+    m_report.busQueueDepth.record(m_queuedBusTransactions.size());
   }
+}
 
+void MemorySystem::tickInterconnect(std::vector<MemoryRequest>& completedMemoryRequests) {
+  tickBus(completedMemoryRequests);
+}
+
+template <typename Protocol>
+void MemorySystem::tickBus(std::vector<MemoryRequest>& completedMemoryRequests) {
   // Handle bus transaction
-  if (!m_queuedBusTransactions.empty()) {
+  if (m_maxOutstandingMemoryTransactions > 0) {
+    tickSplitBus<Protocol>(completedMemoryRequests);
+  } else if (!m_queuedBusTransactions.empty() || issueQueuedPrefetch()) {
     BusTransaction& currBusTransaction = m_queuedBusTransactions.front();
     if (!currBusTransaction.processed) { // new bus transaction process it
-      processBusTransaction(currBusTransaction);
+      startBusTransaction<Protocol>(currBusTransaction);
     } 
   
     --currBusTransaction.remainingCycles; // execute 1 cycle of the curr bus transaction
   
     if (currBusTransaction.remainingCycles == 0) { // curr bus transaction completed add to completed and remove from queue
-      completedMemoryRequests.push_back(currBusTransaction.request);
+      const MemoryRequest request = currBusTransaction.request;
       m_queuedBusTransactions.pop();
+      completeBusTransaction<Protocol>(request, completedMemoryRequests);
     }
   }
 }
 
-std::pair<uint32_t, int> MemorySystem::findInCache(int cacheNum, uint32_t address) const {
-  uint32_t setIdx = getSetIdx(address);
-  uint32_t tag = getTag(address);
-  const std::vector<CacheLine>& set = m_l1Caches[cacheNum][setIdx];
-  for (int i = 0; i < set.size(); ++i) {
-    if ((set[i].tag == tag) && (set[i].state != INVALID)) {
-      return {setIdx, i};
+int MemorySystem::cyclesUntilNextEvent() const {
+  return std::min(m_executingNonBusRequests.cyclesUntilNextCompletion(), m_usesBus ? MemorySystem::cyclesUntilInterconnectEvent() : cyclesUntilInterconnectEvent());
+}
+
+void MemorySystem::skipCycles(const long long cycles) {
+  for (int coreNum = 0; coreNum < m_mshrsByCore.size() && m_numMshrs > 0; ++coreNum) {
+    if (!m_mshrsByCore[coreNum].empty()) {
+      m_report.outstandingMissCycles[coreNum] += cycles;
+      m_report.outstandingMissSum[coreNum] += cycles * m_mshrsByCore[coreNum].size();
     }
   }
-  return {setIdx, INVALID_BLOCK_IDX};
+  m_executingNonBusRequests.skip(cycles);
+  if (m_usesBus) {
+    MemorySystem::skipInterconnectCycles(cycles);
+    m_report.busQueueDepth.record(m_queuedBusTransactions.size(), cycles); // nothing joins or leaves the queues while skipping
+  } else {
+    skipInterconnectCycles(cycles);
+    m_report.busQueueDepth.record(countQueuedTransactions(), cycles);
+  }
 }
 
-int MemorySystem::findBlockIdxToReplace(const int coreNum, const uint32_t setIdx) const {
-  int earliestLastUsed = std::numeric_limits<int>::max();
-  int minIdx = -1;
-  for (int blockIdx = 0; blockIdx < associativity; ++blockIdx) {
-    const CacheLine& cacheLine = m_l1Caches[coreNum][setIdx][blockIdx];
-    if (cacheLine.state == INVALID) { // return immediately if there is an invalid cache line
-      return blockIdx;
+void MemorySystem::skipInterconnectCycles(const long long cycles) {
+  if (m_maxOutstandingMemoryTransactions > 0) {
+    skipSplitBusCycles(cycles);
+    return;
+  }
+  // only the bus transaction at the front of the queue progresses, the rest are waiting for the bus
+  if (!m_queuedBusTransactions.empty()) {
+    m_queuedBusTransactions.front().remainingCycles -= cycles;
+  }
+}
+
+int MemorySystem::cyclesUntilBusEvent() const {
+  if (!m_executingNonBusRequests.empty()) return 0;
+  return m_usesBus ? MemorySystem::cyclesUntilInterconnectEvent() : cyclesUntilInterconnectEvent();
+}
+
+int MemorySystem::cyclesUntilInterconnectEvent() const {
+  if (m_maxOutstandingMemoryTransactions > 0) {
+    return cyclesUntilSplitBusEvent();
+  }
+  if (m_queuedBusTransactions.empty()) {
+    return m_queuedPrefetches.empty() ? std::numeric_limits<int>::max() : 0;
+  }
+  const BusTransaction& currBusTransaction = m_queuedBusTransactions.front();
+  return currBusTransaction.processed ? currBusTransaction.remainingCycles - 1 : 0; // completes on the tick its remaining cycles reach 0
+}
+
+template <typename Protocol>
+void MemorySystem::tickSplitBus(std::vector<MemoryRequest>& completedMemoryRequests) {
+  // Memory phases progress in parallel, finished ones queue to return their block over the bus
+  for (int i = 0; i < m_outstandingMemoryTransactions.size();) {
+    BusTransaction& transaction = m_outstandingMemoryTransactions[i];
+    if (--transaction.remainingCycles > 0) {
+      ++i;
+      continue;
     }
-    if (cacheLine.lastUsed < earliestLastUsed) { // else if less than curr earliest used, replace it
-      earliestLastUsed = cacheLine.lastUsed;
-      minIdx = blockIdx;
+    transaction.remainingCycles = SPLIT_BUS_RESPONSE_CYCLES;
+    m_queuedBusResponses.push(transaction);
+    m_outstandingMemoryTransactions.erase(m_outstandingMemoryTransactions.begin() + i);
+  }
+
+  // A request phase holds the bus until it is done, the bus then goes to responses before new requests
+  const bool isRequestOnBus = !m_queuedBusTransactions.empty() && m_queuedBusTransactions.front().processed;
+  if (!isRequestOnBus && !m_isBusResponding && !m_queuedBusResponses.empty()) {
+    m_isBusResponding = true;
+  }
+
+  if (m_isBusResponding) {
+    BusTransaction& response = m_queuedBusResponses.front();
+    if (--response.remainingCycles == 0) {
+      const MemoryRequest request = response.request;
+      m_queuedBusResponses.pop();
+      m_isBusResponding = false;
+      completeBusTransaction<Protocol>(request, completedMemoryRequests);
     }
+    return;
+  }
+
+  if (m_queuedBusTransactions.empty() && !issueQueuedPrefetch()) {
+    return;
+  }
+  BusTransaction& currBusTransaction = m_queuedBusTransactions.front();
+  if (!currBusTransaction.processed) {
+    if (isBlockInFlight(currBusTransaction.request.address)) { // other caches may not have the block yet, wait until it arrives
+      ++m_report.numInFlightBlockStallCycles;
+      return;
+    }
+    const long long memoryCyclesLoggedBefore = m_memoryCyclesLogged;
+    startBusTransaction<Protocol>(currBusTransaction);
+    currBusTransaction.memoryCycles += m_memoryCyclesLogged - memoryCyclesLoggedBefore;
+    currBusTransaction.remainingCycles -= currBusTransaction.memoryCycles; // only the request phase is on the bus
+  }
+
+  if (currBusTransaction.remainingCycles > 0) {
+    --currBusTransaction.remainingCycles;
+  }
+  if (currBusTransaction.remainingCycles > 0) {
+    return;
+  }
+
+  if (currBusTransaction.memoryCycles == 0) { // served by the caches alone
+    const MemoryRequest request = currBusTransaction.request;
+    m_queuedBusTransactions.pop();
+    completeBusTransaction<Protocol>(request, completedMemoryRequests);
+  } else if (m_outstandingMemoryTransactions.size() < m_maxOutstandingMemoryTransactions) {
+    currBusTransaction.remainingCycles = currBusTransaction.memoryCycles;
+    m_outstandingMemoryTransactions.push_back(currBusTransaction);
+    m_queuedBusTransactions.pop();
+  } else { // keep holding the bus until a memory slot frees up
+    ++m_report.numMemorySlotStallCycles;
   }
-  return minIdx; // return least recently used block
 }
 
-void MesiMemorySystem::handleIncomingRequest(const MemoryRequest& request) {
+bool MemorySystem::isBlockInFlight(const uint64_t address) const {
+  const uint64_t blockAddress = m_geometry.getBlockAddress(address);
+  for (const BusTransaction& transaction : m_outstandingMemoryTransactions) {
+    if (m_geometry.getBlockAddress(transaction.request.address) == blockAddress) return true;
+  }
+  return m_queuedBusResponses.anyOf([&](const BusTransaction& response) {return m_geometry.getBlockAddress(response.request.address) == blockAddress;});
+}
+
+int MemorySystem::cyclesUntilSplitBusEvent() const {
+  int cycles = std::numeric_limits<int>::max();
+  for (const BusTransaction& transaction : m_outstandingMemoryTransactions) {
+    cycles = std::min(cycles, transaction.remainingCycles - 1); // memory phase ends on the tick its remaining cycles reach 0
+  }
+
+  if (m_isBusResponding) {
+    return std::min(cycles, m_queuedBusResponses.front().remainingCycles - 1);
+  }
+  if (m_queuedBusTransactions.empty()) {
+    return (m_queuedBusResponses.empty() && m_queuedPrefetches.empty()) ? cycles : 0;
+  }
+  const BusTransaction& currBusTransaction = m_queuedBusTransactions.front();
+  if (currBusTransaction.processed) {
+    // still in its request phase, else stalled until a memory phase ends
+    return (currBusTransaction.remainingCycles > 0) ? std::min(cycles, currBusTransaction.remainingCycles - 1) : cycles;
+  }
+  if (!m_queuedBusResponses.empty() || !isBlockInFlight(currBusTransaction.request.address)) {
+    return 0; // bus is free for the next response or request
+  }
+  return cycles; // waiting for the in flight block
+}
+
+void MemorySystem::skipSplitBusCycles(const long long cycles) {
+  for (BusTransaction& transaction : m_outstandingMemoryTransactions) {
+    transaction.remainingCycles -= cycles;
+  }
+  if (m_isBusResponding) {
+    m_queuedBusResponses.front().remainingCycles -= cycles;
+  } else if (!m_queuedBusTransactions.empty()) {
+    BusTransaction& currBusTransaction = m_queuedBusTransactions.front();
+    if (!currBusTransaction.processed) {
+      m_report.numInFlightBlockStallCycles += cycles;
+    } else if (currBusTransaction.remainingCycles == 0) {
+      m_report.numMemorySlotStallCycles += cycles;
+    } else {
+      currBusTransaction.remainingCycles -= cycles;
+    }
+  }
+}
+
+bool MemorySystem::isLocalHit(const MemoryRequest& request) const {
   auto [setIdx, blockIdx] = findInCache(request.coreNum, request.address);
-  ////// in cache //////
+  if (blockIdx == INVALID_BLOCK_IDX) {
+    return false;
+  }
+  const CACHELINE_STATE state = m_l1Caches[request.coreNum].states[size_t(setIdx) * m_geometry.associativity + blockIdx];
+  return request.type == Architecture::LOAD || state == EXCLUSIVE || state == MODIFIED;
+}
+
+void MemorySystem::serviceLocalHit(const MemoryRequest& request) {
+  auto [setIdx, blockIdx] = findInCache(request.coreNum, request.address);
+  ++m_report.numCacheHits[request.coreNum];
+  CacheLineRef cacheLine = getCacheLine(request.coreNum, setIdx, blockIdx);
+  updateOnLocalHit(request, cacheLine);
+  profileAccess(request, cacheLine);
+}
+
+std::pair<uint32_t, int> MemorySystem::findInCache(int cacheNum, uint64_t address) const {
+  uint32_t setIdx = m_geometry.getSetIdx(address);
+  uint64_t tag = m_geometry.getTag(address);
+  const size_t setStart = size_t(setIdx) * m_geometry.associativity;
+  const L1Cache& cache = m_l1Caches[cacheNum];
+  return {setIdx, findValidTagInSet(&cache.tags[setStart], &cache.states[setStart], m_geometry.associativity, tag)};
+}
+
+const std::vector<int>& MemorySystem::getSnoopTargets(const int initiatingCoreIdx, const uint64_t address) {
+  m_snoopTargets.clear();
+  if (m_l2Config.useAsSnoopFilter) { // inclusion means cores without a presence bit can not hold the block
+    uint32_t l2SetIdx;
+    const int l2BlockIdx = findInL2(address, l2SetIdx);
+    if (l2BlockIdx != INVALID_BLOCK_IDX) {
+      const uint64_t* bits = &m_l2PresenceBits[(size_t(l2SetIdx) * m_l2Config.geometry.associativity + l2BlockIdx) * m_l2PresenceWordsPerLine];
+      for (int wordIdx = 0; wordIdx < m_l2PresenceWordsPerLine; ++wordIdx) {
+        for (uint64_t word = bits[wordIdx]; word != 0; word &= word - 1) {
+          const int coreNum = wordIdx * 64 + std::countr_zero(word);
+          if (coreNum != initiatingCoreIdx) m_snoopTargets.push_back(coreNum);
+        }
+      }
+    }
+    m_report.numSnoopsAvoided += (m_numCores - 1) - m_snoopTargets.size();
+    return m_snoopTargets;
+  }
+  if (!m_snoopFilterPtr) {
+    for (int otherCoreIdx = 0; otherCoreIdx < m_numCores; ++otherCoreIdx) {
+      if (otherCoreIdx != initiatingCoreIdx) m_snoopTargets.push_back(otherCoreIdx);
+    }
+    return m_snoopTargets;
+  }
+
+  m_snoopFilterPtr->getSharers(m_geometry.getBlockAddress(address), initiatingCoreIdx, m_snoopTargets);
+  m_report.numSnoopsAvoided += (m_numCores - 1) - m_snoopTargets.size();
+  return m_snoopTargets;
+}
+
+int MemorySystem::evictL1Line(const int coreNum, const uint64_t blockAddress, const bool isDirty) {
+  int cycles = 0;
+  if (isDirty) {
+    cycles = getAndLog_L1_CACHE_WRITE_BACK_CYCLES(blockAddress);
+  } else if (m_l2CachePtr && m_l2Config.policy == L2_EXCLUSIVE) { // clean victims move down to an exclusive L2 too
+    m_report.busDataTrafficBytes += m_geometry.blockSize;
+    cycles = writeToL2(blockAddress, false, m_cycleCounter.getCounter());
+    m_memoryCyclesLogged += cycles;
+  }
+  removeFromSnoopFilter(coreNum, blockAddress); // evicted block is no longer held by this core
+  return cycles;
+}
+
+int MemorySystem::findInL2(const uint64_t address, uint32_t& setIdx) const {
+  const CacheGeometry& l2Geometry = m_l2Config.geometry;
+  setIdx = l2Geometry.getSetIdx(address);
+  const size_t setStart = size_t(setIdx) * l2Geometry.associativity;
+  return findValidTagInSet(&m_l2CachePtr->tags[setStart], &m_l2CachePtr->states[setStart], l2Geometry.associativity, l2Geometry.getTag(address));
+}
+
+int MemorySystem::loadThroughL2(const uint64_t address, const long long accessCycle) {
+  uint32_t setIdx;
+  const int blockIdx = findInL2(address, setIdx);
   if (blockIdx != INVALID_BLOCK_IDX) {
-    ++Architecture::GlobalReport::numCacheHits[request.coreNum];
-
-    CacheLine& cacheLine = m_l1Caches[request.coreNum][setIdx][blockIdx];
-    // Load Request: All loads from valid cache lines happen without bus transaction and state change
-    if (request.type == Architecture::INSTRUCTION_TYPE::LOAD) {
-      if (cacheLine.state == SHARED) {
-        ++Architecture::GlobalReport::numSharedAccess;
-      } else {
-        ++Architecture::GlobalReport::numPrivateAccess;
+    ++m_report.numL2Hits;
+    const size_t lineIdx = size_t(setIdx) * m_l2Config.geometry.associativity + blockIdx;
+    if (m_l2Config.policy == L2_EXCLUSIVE) { // moves up to the L1, which gets a clean copy
+      if (m_l2CachePtr->states[lineIdx] == MODIFIED) {
+        m_report.memoryTrafficBytes += m_l2Config.geometry.blockSize; // written back off the critical path
+        writeToMemory(m_l2Config.geometry.getBlockAddress(address), accessCycle + m_l2Config.hitCycles);
       }
+      m_l2CachePtr->states[lineIdx] = INVALID;
+    } else {
+      m_l2ReplacementPtr->touch(setIdx, blockIdx);
+    }
+    return m_l2Config.hitCycles;
+  }
+
+  ++m_report.numL2Misses;
+  m_report.memoryTrafficBytes += m_l2Config.geometry.blockSize;
+  int cycles = m_l2Config.hitCycles + readFromMemory(m_l2Config.geometry.getBlockAddress(address), accessCycle + m_l2Config.hitCycles);
+  if (m_l2Config.policy != L2_EXCLUSIVE) {
+    cycles += insertIntoL2(address, false, accessCycle);
+  }
+  return cycles;
+}
 
-      cacheLine.lastUsed = Architecture::GlobalCycleCounter::getCounter(); // set last used to now
-      m_executingNonBusRequests.emplace_back(request, L1_CACHE_HIT_CYCLES);
+int MemorySystem::writeToL2(const uint64_t address, const bool isDirty, const long long accessCycle) {
+  uint32_t setIdx;
+  const int blockIdx = findInL2(address, setIdx);
+  if (blockIdx == INVALID_BLOCK_IDX) {
+    return m_l2Config.hitCycles + insertIntoL2(address, isDirty, accessCycle);
+  }
+  const size_t lineIdx = size_t(setIdx) * m_l2Config.geometry.associativity + blockIdx;
+  if (isDirty) {
+    m_l2CachePtr->states[lineIdx] = MODIFIED;
+  }
+  m_l2ReplacementPtr->touch(setIdx, blockIdx);
+  return m_l2Config.hitCycles;
+}
+
+int MemorySystem::insertIntoL2(const uint64_t address, const bool isDirty, const long long accessCycle) {
+  const CacheGeometry& l2Geometry = m_l2Config.geometry;
+  const uint32_t setIdx = l2Geometry.getSetIdx(address);
+  const size_t setStart = size_t(setIdx) * l2Geometry.associativity;
+  int blockIdx = findInvalidBlockInSet(&m_l2CachePtr->states[setStart], l2Geometry.associativity);
+  if (blockIdx == INVALID_BLOCK_IDX) {
+    blockIdx = m_l2ReplacementPtr->findVictim(setIdx, {});
+  }
+  const int cycles = (m_l2CachePtr->states[setStart + blockIdx] != INVALID) ? evictFromL2(setIdx, blockIdx, accessCycle) : 0;
+
+  const size_t lineIdx = setStart + blockIdx;
+  m_l2CachePtr->tags[lineIdx] = l2Geometry.getTag(address);
+  m_l2CachePtr->states[lineIdx] = isDirty ? MODIFIED : SHARED;
+  m_l2ReplacementPtr->insert(setIdx, blockIdx);
+  std::fill_n(m_l2PresenceBits.begin() + lineIdx * m_l2PresenceWordsPerLine, m_l2PresenceWordsPerLine, 0);
+  return cycles;
+}
+
+int MemorySystem::evictFromL2(const uint32_t setIdx, const int blockIdx, const long long accessCycle) {
+  const size_t lineIdx = size_t(setIdx) * m_l2Config.geometry.associativity + blockIdx;
+  bool isDirty = m_l2CachePtr->states[lineIdx] == MODIFIED;
+  if (m_l2Config.policy == L2_INCLUSIVE) {
+    isDirty |= backInvalidate(lineIdx, m_l2Config.geometry.getBlockAddress(m_l2CachePtr->tags[lineIdx], setIdx));
+  }
+  m_l2CachePtr->states[lineIdx] = INVALID;
+  if (!isDirty) {
+    return 0;
+  }
+  m_report.memoryTrafficBytes += m_l2Config.geometry.blockSize;
+  return writeToMemory(m_l2Config.geometry.getBlockAddress(m_l2CachePtr->tags[lineIdx], setIdx), accessCycle + m_l2Config.hitCycles);
+}
+
+int MemorySystem::readFromMemory(const uint64_t blockAddress, const long long accessCycle) {
+  if (!m_dramPtr) {
+    return L1_CACHE_LOAD_FROM_MEM_CYCLES;
+  }
+  return m_dramPtr->read(blockAddress, accessCycle) - accessCycle;
+}
+
+int MemorySystem::writeToMemory(const uint64_t blockAddress, const long long accessCycle) {
+  if (!m_dramPtr) {
+    return L1_CACHE_WRITE_BACK_CYCLES;
+  }
+  // Only waits for the write buffer to take the block, the write itself happens off the critical path
+  return m_dramPtr->write(blockAddress, accessCycle) - accessCycle + L1_CACHE_LOAD_FROM_BUS_PER_WORD_CYCLES * m_geometry.wordsPerBlock;
+}
+
+bool MemorySystem::backInvalidate(const size_t l2LineIdx, const uint64_t blockAddress) {
+  bool isDirty = false;
+  for (int coreNum = 0; coreNum < m_numCores; ++coreNum) {
+    // Only cores with a presence bit can hold the block when the L2 is the snoop filter, read before it is cleared below
+    if (m_l2Config.useAsSnoopFilter && !((m_l2PresenceBits[l2LineIdx * m_l2PresenceWordsPerLine + coreNum / 64] >> (coreNum % 64)) & 1)) continue;
+
+    for (int offset = 0; offset < m_l2Config.geometry.blockSize; offset += m_geometry.blockSize) { // every L1 block within the L2 block
+      const uint64_t address = blockAddress + offset;
+      auto [setIdx, blockIdx] = snoopCache(coreNum, address);
+      if (blockIdx == INVALID_BLOCK_IDX) continue;
+
+      CacheLineRef cacheLine = getCacheLine(coreNum, setIdx, blockIdx);
+      isDirty |= cacheLine.state == MODIFIED || cacheLine.state == OWNED || cacheLine.state == SHARED_MODIFIED;
+      cacheLine.state = INVALID;
+      removeFromSnoopFilter(coreNum, address);
+      ++m_report.numL2BackInvalidations;
+    }
+  }
+  return isDirty;
+}
+
+void MemorySystem::setL2Presence(const int coreNum, const uint64_t blockAddress, const bool isPresent) {
+  uint32_t setIdx;
+  const int blockIdx = findInL2(blockAddress, setIdx);
+  if (blockIdx == INVALID_BLOCK_IDX) return;
+
+  uint64_t& word = m_l2PresenceBits[(size_t(setIdx) * m_l2Config.geometry.associativity + blockIdx) * m_l2PresenceWordsPerLine + coreNum / 64];
+  if (isPresent) {
+    word |= uint64_t(1) << (coreNum % 64);
+  } else if (m_l2Config.geometry.blockSize == m_geometry.blockSize) { // else the core may still hold another part of the L2 block
+    word &= ~(uint64_t(1) << (coreNum % 64));
+  }
+}
+
+int MemorySystem::findBlockIdxToReplace(const int coreNum, const uint32_t setIdx) {
+  const size_t setStart = size_t(setIdx) * m_geometry.associativity;
+  const CACHELINE_STATE* states = &m_l1Caches[coreNum].states[setStart];
+  const int associativity = m_geometry.associativity;
+  if (m_numMshrs == 0) {
+    const int blockIdx = findInvalidBlockInSet(states, associativity);
+    return (blockIdx != INVALID_BLOCK_IDX) ? blockIdx : m_replacementByCore[coreNum]->findVictim(setIdx, m_reservedWays);
+  }
+
+  m_reservedWays.clear();
+  for (const Mshr& mshr : m_mshrsByCore[coreNum]) {
+    if (mshr.setIdx == setIdx) m_reservedWays.push_back(mshr.blockIdx);
+  }
+  for (int blockIdx = 0; blockIdx < associativity; ++blockIdx) {
+    if (states[blockIdx] == INVALID && std::find(m_reservedWays.begin(), m_reservedWays.end(), blockIdx) == m_reservedWays.end()) return blockIdx;
+  }
+  if (m_reservedWays.size() >= associativity) {
+    return INVALID_BLOCK_IDX;
+  }
+  return m_replacementByCore[coreNum]->findVictim(setIdx, m_reservedWays);
+}
+
+bool MemorySystem::isWayReserved(const int coreNum, const uint32_t setIdx, const int blockIdx) const {
+  for (const Mshr& mshr : m_mshrsByCore[coreNum]) {
+    if (mshr.setIdx == setIdx && mshr.blockIdx == blockIdx) return true;
+  }
+  return false;
+}
+
+int MemorySystem::countReservedWays(const int coreNum, const uint32_t setIdx) const {
+  return std::count_if(m_mshrsByCore[coreNum].begin(), m_mshrsByCore[coreNum].end(), [&](const Mshr& mshr) {return mshr.setIdx == setIdx;});
+}
+
+bool MemorySystem::canAcceptRequest(const MemoryRequest& request) const {
+  if (m_numMshrs == 0) {
+    return true;
+  }
+  const std::vector<Mshr>& mshrs = m_mshrsByCore[request.coreNum];
+  const uint64_t blockAddress = m_geometry.getBlockAddress(request.address);
+  for (const Mshr& mshr : mshrs) {
+    if (mshr.blockAddress == blockAddress) return true; // merges
+  }
+  if (isLocalHit(request)) {
+    return true;
+  }
+  if (mshrs.size() >= m_numMshrs) {
+    return false;
+  }
+  auto [setIdx, blockIdx] = findInCache(request.coreNum, request.address);
+  // Any way not reserved can be replaced, without asking the replacement policy which would update its state
+  return blockIdx != INVALID_BLOCK_IDX || countReservedWays(request.coreNum, setIdx) < m_geometry.associativity;
+}
+
+void MemorySystem::enqueueBusTransaction(const MemoryRequest& request, const uint32_t setIdx, const int blockIdx, const int writeBackCycles) {
+  m_queuedBusTransactions.emplace(request, setIdx, blockIdx, writeBackCycles);
+  if (m_numMshrs > 0) {
+    std::vector<MemoryRequest> mergedRequests;
+    if (!m_freeMergedRequestLists.empty()) { // reuse the storage of a completed MSHR
+      mergedRequests = std::move(m_freeMergedRequestLists.back());
+      m_freeMergedRequestLists.pop_back();
+    }
+    m_mshrsByCore[request.coreNum].push_back({m_geometry.getBlockAddress(request.address), setIdx, blockIdx, std::move(mergedRequests)});
+  }
+}
+
+template <typename Protocol>
+void MemorySystem::completeBusTransaction(const MemoryRequest& request, std::vector<MemoryRequest>& completedMemoryRequests) {
+  if (request.isPrefetch) {
+    completePrefetch<Protocol>(request); // no core is waiting on the prefetch itself
+    return;
+  }
+  completedMemoryRequests.push_back(request);
+  if (m_numMshrs == 0) {
+    return;
+  }
+
+  std::vector<Mshr>& mshrs = m_mshrsByCore[request.coreNum];
+  const uint64_t blockAddress = m_geometry.getBlockAddress(request.address);
+  auto mshrIt = std::find_if(mshrs.begin(), mshrs.end(), [&](const Mshr& mshr) {return mshr.blockAddress == blockAddress;});
+  std::vector<MemoryRequest> mergedRequests = std::move(mshrIt->mergedRequests);
+  mshrs.erase(mshrIt);
+  // Merged requests go through the protocol again now the block is here, a store may still need to upgrade a shared line
+  for (const MemoryRequest& mergedRequest : mergedRequests) {
+    acceptRequest<Protocol>(mergedRequest);
+  }
+  mergedRequests.clear();
+  m_freeMergedRequestLists.push_back(std::move(mergedRequests));
+}
+
+template <typename Protocol>
+void MemorySystem::acceptRequest(const MemoryRequest& request) {
+  if (m_numMshrs > 0 && mergeIntoMshr(request)) {
+    return; // block already on its way
+  }
+  if (!m_prefetchersByCore.empty()) {
+    if (mergeIntoPrefetch(request)) {
       return;
     }
+    trainPrefetcher(request);
+  }
+  handleIncomingRequestAs<Protocol>(request);
+}
+
+void MemorySystem::trainPrefetcher(const MemoryRequest& request) {
+  const int coreNum = request.coreNum;
+  const bool isHit = findInCache(coreNum, request.address).second != INVALID_BLOCK_IDX;
+  const bool isFirstAccessToPrefetch = m_prefetchedBlocksByCore[coreNum].erase(m_geometry.getBlockAddress(request.address)) > 0;
+  m_report.numUsefulPrefetches += isFirstAccessToPrefetch && isHit; // else evicted or invalidated before it was used
+
+  m_prefetchAddresses.clear();
+  m_prefetchersByCore[coreNum]->onAccess(request.address, !isHit || isFirstAccessToPrefetch, m_prefetchAddresses);
+  for (const uint64_t address : m_prefetchAddresses) {
+    queuePrefetch(coreNum, address);
+  }
+}
+
+void MemorySystem::queuePrefetch(const int coreNum, const uint64_t address) {
+  const uint64_t blockAddress = m_geometry.getBlockAddress(address);
+  if (m_queuedPrefetches.size() >= MAX_QUEUED_PREFETCHES || findInCache(coreNum, blockAddress).second != INVALID_BLOCK_IDX) {
+    return;
+  }
+  auto isSameBlock = [&](const MemoryRequest& prefetch) {return prefetch.coreNum == coreNum && prefetch.address == blockAddress;};
+  auto isSameInFlightBlock = [&](const InFlightPrefetch& prefetch) {return prefetch.coreNum == coreNum && prefetch.blockAddress == blockAddress;};
+  if (std::any_of(m_queuedPrefetches.begin(), m_queuedPrefetches.end(), isSameBlock) || std::any_of(m_inFlightPrefetches.begin(), m_inFlightPrefetches.end(), isSameInFlightBlock)) {
+    return;
+  }
+  m_queuedPrefetches.emplace_back(coreNum, Architecture::LOAD, blockAddress, 0, true);
+}
+
+bool MemorySystem::issueQueuedPrefetch() {
+  while (!m_queuedPrefetches.empty()) {
+    const MemoryRequest prefetch = m_queuedPrefetches.front();
+    m_queuedPrefetches.pop_front();
+    if (findInCache(prefetch.coreNum, prefetch.address).second != INVALID_BLOCK_IDX || (m_maxOutstandingMemoryTransactions > 0 && isBlockInFlight(prefetch.address))) {
+      ++m_report.numDroppedPrefetches; // fetched on demand since it was queued, or about to be
+      continue;
+    }
+    m_queuedBusTransactions.emplace(prefetch, 0, INVALID_BLOCK_IDX); // line is allocated once it is processed
+    m_inFlightPrefetches.push_back({prefetch.coreNum, prefetch.address, {}});
+    return true;
+  }
+  return false;
+}
 
-    // Exclusive/Modified State Store Request: can write and return immediately
-    if (cacheLine.state == EXCLUSIVE || cacheLine.state == MODIFIED) {
-      ++Architecture::GlobalReport::numPrivateAccess;
+bool MemorySystem::mergeIntoPrefetch(const MemoryRequest& request) {
+  const uint64_t blockAddress = m_geometry.getBlockAddress(request.address);
+  for (InFlightPrefetch& prefetch : m_inFlightPrefetches) {
+    if (prefetch.coreNum == request.coreNum && prefetch.blockAddress == blockAddress) {
+      prefetch.waitingRequests.push_back(request);
+      return true;
+    }
+  }
+  auto queuedIt = std::find_if(m_queuedPrefetches.begin(), m_queuedPrefetches.end(), [&](const MemoryRequest& prefetch) {
+    return prefetch.coreNum == request.coreNum && prefetch.address == blockAddress;
+  });
+  if (queuedIt != m_queuedPrefetches.end()) { // the demand miss fetches the block itself
+    ++m_report.numDroppedPrefetches;
+    m_queuedPrefetches.erase(queuedIt);
+  }
+  return false;
+}
 
-      cacheLine.state = MODIFIED; // write changes exclusive to modified state, modified stays as modified
-      cacheLine.lastUsed = Architecture::GlobalCycleCounter::getCounter(); // set last used to now
-      m_executingNonBusRequests.emplace_back(request, L1_CACHE_HIT_CYCLES);
+template <typename Protocol>
+void MemorySystem::processPrefetch(BusTransaction& transaction) {
+  const int coreNum = transaction.request.coreNum;
+  auto [setIdx, blockIdx] = findInCache(coreNum, transaction.request.address);
+  if (blockIdx == INVALID_BLOCK_IDX) {
+    blockIdx = findBlockIdxToReplace(coreNum, setIdx);
+  } else {
+    blockIdx = INVALID_BLOCK_IDX; // fetched by another transaction while waiting for the bus
+  }
+  if (blockIdx == INVALID_BLOCK_IDX) { // also when every way is reserved by outstanding misses
+    transaction.remainingCycles += L1_CACHE_HIT_CYCLES; // only the tag check
+    transaction.processed = true;
+    return;
+  }
+
+  // Prefetches are not data accesses, and count their bus traffic separately
+  const long long numPrivateAccess = m_report.numPrivateAccess;
+  const long long numSharedAccess = m_report.numSharedAccess;
+  const long long busDataTrafficBytes = m_report.busDataTrafficBytes;
+
+  CacheLineRef cacheLine = getCacheLine(coreNum, setIdx, blockIdx);
+  if (cacheLine.state != INVALID) {
+    transaction.remainingCycles += evictL1Line(coreNum, m_geometry.getBlockAddress(cacheLine.tag, setIdx), cacheLine.state == MODIFIED || cacheLine.state == OWNED);
+  }
+  cacheLine.tag = m_geometry.getTag(transaction.request.address);
+  cacheLine.state = INVALID;
+  insertLine(coreNum, cacheLine);
+  transaction.setIdx = setIdx;
+  transaction.blockIdx = blockIdx;
+  processBusTransactionAs<Protocol>(transaction); // as a load
+
+  m_report.numPrivateAccess = numPrivateAccess;
+  m_report.numSharedAccess = numSharedAccess;
+  m_report.prefetchBusDataTrafficBytes += m_report.busDataTrafficBytes - busDataTrafficBytes;
+  ++m_report.numPrefetchesIssued;
+  m_prefetchedBlocksByCore[coreNum].insert(transaction.request.address);
+  for (InFlightPrefetch& prefetch : m_inFlightPrefetches) {
+    if (prefetch.coreNum == coreNum && prefetch.blockAddress == transaction.request.address) {
+      prefetch.issued = true;
+      break;
+    }
+  }
+}
+
+template <typename Protocol>
+void MemorySystem::startBusTransaction(BusTransaction& transaction) {
+  if (transaction.request.isPrefetch) {
+    processPrefetch<Protocol>(transaction);
+    return;
+  }
+  const long long numBlocksFromCaches = m_numBlocksFromCaches;
+  processBusTransactionAs<Protocol>(transaction);
+  profileAccess(transaction.request, getCacheLine(transaction.request.coreNum, transaction.setIdx, transaction.blockIdx));
+  transaction.request.source = (m_numBlocksFromCaches != numBlocksFromCaches) ? Architecture::CACHE_TO_CACHE : Architecture::MEMORY;
+  if (m_numBlocksFromCaches != numBlocksFromCaches) {
+    ++m_report.numCacheToCacheTransfers;
+    m_report.cacheToCacheTransferCycles += transaction.remainingCycles;
+  }
+}
+
+template <typename Protocol>
+void MemorySystem::completePrefetch(const MemoryRequest& request) {
+  auto prefetchIt = std::find_if(m_inFlightPrefetches.begin(), m_inFlightPrefetches.end(), [&](const InFlightPrefetch& prefetch) {
+    return prefetch.coreNum == request.coreNum && prefetch.blockAddress == request.address;
+  });
+  std::vector<MemoryRequest> waitingRequests = std::move(prefetchIt->waitingRequests);
+  m_report.numLatePrefetches += prefetchIt->issued && !waitingRequests.empty(); // once however many demand requests waited
+  m_inFlightPrefetches.erase(prefetchIt);
+  for (const MemoryRequest& waitingRequest : waitingRequests) {
+    acceptRequest<Protocol>(waitingRequest);
+  }
+}
+
+bool MemorySystem::mergeIntoMshr(const MemoryRequest& request) {
+  const uint64_t blockAddress = m_geometry.getBlockAddress(request.address);
+  for (Mshr& mshr : m_mshrsByCore[request.coreNum]) {
+    if (mshr.blockAddress == blockAddress) {
+      mshr.mergedRequests.push_back(request);
+      return true;
+    }
+  }
+  return false;
+}
+
+void MesiMemorySystem::handleIncomingRequest(const MemoryRequest& request) {
+  auto [setIdx, blockIdx] = findInCache(request.coreNum, request.address);
+  ////// in cache //////
+  if (blockIdx != INVALID_BLOCK_IDX) {
+    ++m_report.numCacheHits[request.coreNum];
+
+    CacheLineRef cacheLine = getCacheLine(request.coreNum, setIdx, blockIdx);
+    // Load Request or Exclusive/Modified State Store Request: can return immediately
+    if (request.type == Architecture::INSTRUCTION_TYPE::LOAD || cacheLine.state == EXCLUSIVE || cacheLine.state == MODIFIED) {
+      updateOnLocalHit(request, cacheLine);
+      profileAccess(request, cacheLine);
+      m_executingNonBusRequests.schedule(request, L1_CACHE_HIT_CYCLES);
       return;
     }
 
     // Shared State Store Request: Need to invalidate all other cache lines through bus transaction, add to bus transaction queue
-    m_queuedBusTransactions.emplace(request, setIdx, blockIdx);
+    enqueueBusTransaction(request, setIdx, blockIdx);
     return;
   }
 
   ////// not in cache //////
-  ++Architecture::GlobalReport::numCacheMisses[request.coreNum];
+  ++m_report.numCacheMisses[request.coreNum];
 
   blockIdx = findBlockIdxToReplace(request.coreNum, setIdx);
-  CacheLine& cacheLine = m_l1Caches[request.coreNum][setIdx][blockIdx];
+  CacheLineRef cacheLine = getCacheLine(request.coreNum, setIdx, blockIdx);
   // We evict the cache line and prepare to load in the new cache line through a bus transaction
   int startingCycles = 0;
-  if (cacheLine.state == MODIFIED) { // if modified, we need to write back the dirty cache line first, so we add the cycles to the initial cycles needed
-    startingCycles += getAndLog_L1_CACHE_WRITE_BACK_CYCLES();
+  if (cacheLine.state != INVALID) { // if modified, we need to write back the dirty cache line first, so we add the cycles to the initial cycles needed
+    startingCycles += evictL1Line(request.coreNum, m_geometry.getBlockAddress(cacheLine.tag, setIdx), cacheLine.state == MODIFIED);
   }
-  cacheLine.tag = getTag(request.address); // set tag
+  cacheLine.tag = m_geometry.getTag(request.address); // set tag
   cacheLine.state = INVALID; // set state
-  cacheLine.lastUsed = Architecture::GlobalCycleCounter::getCounter(); // set last used to now
+  insertLine(request.coreNum, cacheLine);
   // Enqueue bus transaction
-  m_queuedBusTransactions.emplace(request, setIdx, blockIdx, startingCycles);
+  enqueueBusTransaction(request, setIdx, blockIdx, startingCycles);
+}
+
+void MesiMemorySystem::updateOnLocalHit(const MemoryRequest& request, CacheLineRef cacheLine) {
+  // Load Request: All loads from valid cache lines happen without bus transaction and state change
+  if (request.type == Architecture::INSTRUCTION_TYPE::LOAD) {
+    if (cacheLine.state == SHARED) {
+      ++m_report.numSharedAccess;
+    } else {
+      ++m_report.numPrivateAccess;
+    }
+    touchLine(request.coreNum, cacheLine);
+    return;
+  }
+
+  // Exclusive/Modified State Store Request: can write and return immediately
+  ++m_report.numPrivateAccess;
+  cacheLine.state = MODIFIED; // write changes exclusive to modified state, modified stays as modified
+  touchLine(request.coreNum, cacheLine);
 }
 
 void MesiMemorySystem::processBusTransaction(BusTransaction& transaction) {
   int initiatingCoreIdx = transaction.request.coreNum;
-  CacheLine& cacheLine = m_l1Caches[initiatingCoreIdx][transaction.setIdx][transaction.blockIdx];
+  CacheLineRef cacheLine = getCacheLine(initiatingCoreIdx, transaction.setIdx, transaction.blockIdx);
   
   // Load only issues bus transaction if loading from Invalid state
   if (transaction.request.type == Architecture::LOAD) {
     // check other caches for a valid copy of the cache line
     bool foundOtherCopy = false;
-    for (int otherCoreIdx = 0; otherCoreIdx < Architecture::NUM_CORES; ++otherCoreIdx) {
-      if (otherCoreIdx == initiatingCoreIdx) continue; // dont check self
-      auto [otherSetIdx, otherBlockIdx] = findInCache(otherCoreIdx, transaction.request.address);
+    for (int otherCoreIdx : getSnoopTargets(initiatingCoreIdx, transaction.request.address)) {
+      auto [otherSetIdx, otherBlockIdx] = snoopCache(otherCoreIdx, transaction.request.address);
       if (otherBlockIdx == INVALID_BLOCK_IDX) continue; // not in the other cache, continue
       
       // Cache line found in other cache
-      ++Architecture::GlobalReport::numSharedAccess;
+      ++m_report.numSharedAccess;
       foundOtherCopy = true;
-      CacheLine& otherCacheLine = m_l1Caches[otherCoreIdx][otherSetIdx][otherBlockIdx]; // get other cache line
+      CacheLineRef otherCacheLine = getCacheLine(otherCoreIdx, otherSetIdx, otherBlockIdx); // get other cache line
 
       // NOTE: FALLTHROUGHS HERE ARE INTENTIONAL FOR THE LOGIC 
       switch (otherCacheLine.state) {
       case MODIFIED: // we need to write back the dirty cache line
-        transaction.remainingCycles += getAndLog_L1_CACHE_WRITE_BACK_CYCLES();
+        transaction.remainingCycles += getAndLog_L1_CACHE_WRITE_BACK_CYCLES(m_geometry.getBlockAddress(transaction.request.address));
         [[fallthrough]];
       case EXCLUSIVE:
         [[fallthrough]];
@@ -270,54 +1079,56 @@ void MesiMemorySystem::processBusTransaction(BusTransaction& transaction) {
 
     // didnt find other copy, need to load from memory
     if (!foundOtherCopy) {
-      ++Architecture::GlobalReport::numPrivateAccess;
+      ++m_report.numPrivateAccess;
 
       cacheLine.state = EXCLUSIVE; // transition self state to exclusive
-      transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_FROM_MEM_CYCLES() + L1_CACHE_HIT_CYCLES;
+      transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_FROM_MEM_CYCLES(transaction.request.address) + L1_CACHE_HIT_CYCLES;
     }
   } 
 
   // Store issues bus transaction when storing from invalid or shared state
   else {
-    ++Architecture::GlobalReport::busInvalidationsOrUpdates;
+    ++m_report.busInvalidationsOrUpdates;
 
     // There could be other caches holding this line, need to invalidate all of them first
     bool foundOtherCopy = false;
     bool hasCacheLine = cacheLine.state != INVALID;
-    for (int otherCoreIdx = 0; otherCoreIdx < Architecture::NUM_CORES; ++otherCoreIdx) {
-      if (otherCoreIdx == initiatingCoreIdx) continue; // dont check self
-      auto [otherSetIdx, otherBlockIdx] = findInCache(otherCoreIdx, transaction.request.address);
+    for (int otherCoreIdx : getSnoopTargets(initiatingCoreIdx, transaction.request.address)) {
+      auto [otherSetIdx, otherBlockIdx] = snoopCache(otherCoreIdx, transaction.request.address);
       if (otherBlockIdx == INVALID_BLOCK_IDX) continue; // not in the other cache, continue
 
       // Cache line found in other cache
       
       foundOtherCopy = true;
-      CacheLine& otherCacheLine = m_l1Caches[otherCoreIdx][otherSetIdx][otherBlockIdx]; // get other cache line
+      CacheLineRef otherCacheLine = getCacheLine(otherCoreIdx, otherSetIdx, otherBlockIdx); // get other cache line
 
       if (otherCacheLine.state == MODIFIED) { // The other cache line is dirty, we need to write it back to memory
-        transaction.remainingCycles += getAndLog_L1_CACHE_WRITE_BACK_CYCLES();
+        transaction.remainingCycles += getAndLog_L1_CACHE_WRITE_BACK_CYCLES(m_geometry.getBlockAddress(transaction.request.address));
       }
 
       if (!hasCacheLine) { // if we dont have the cache line, we need to get the block from other cache line
         transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_BLOCK_FROM_BUS_CYCLES();
         hasCacheLine = true;
       }
+      profileRemoteWrite(transaction.request.address, otherCoreIdx, otherCacheLine, false);
       otherCacheLine.state = INVALID; // invalidate other cache line
+      removeFromSnoopFilter(otherCoreIdx, m_geometry.getBlockAddress(transaction.request.address));
     }
 
     // Log Memory Access Type
-    if (foundOtherCopy) ++Architecture::GlobalReport::numSharedAccess;
-    else ++Architecture::GlobalReport::numPrivateAccess;
+    if (foundOtherCopy) ++m_report.numSharedAccess;
+    else ++m_report.numPrivateAccess;
 
     // no cache(including us) has the cache line, we need to get the cache line from memory
     if (!hasCacheLine) {
-      transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_FROM_MEM_CYCLES();
+      transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_FROM_MEM_CYCLES(transaction.request.address);
     }
     
     cacheLine.state = MODIFIED; // set self to modified state
     transaction.remainingCycles += L1_CACHE_HIT_CYCLES; // 1 cycle writing into cache
   }
 
+  addToSnoopFilter(initiatingCoreIdx, m_geometry.getBlockAddress(transaction.request.address)); // initiating core now holds a valid copy
   transaction.processed = true; // set to processed 
 }
 
@@ -325,75 +1136,77 @@ void DragonMemorySystem::handleIncomingRequest(const MemoryRequest& request) {
   auto [setIdx, blockIdx] = findInCache(request.coreNum, request.address);
   ////// in cache //////
   if (blockIdx != INVALID_BLOCK_IDX) {
-    ++Architecture::GlobalReport::numCacheHits[request.coreNum];
-
-    CacheLine& cacheLine = m_l1Caches[request.coreNum][setIdx][blockIdx];
-    // Load Request: All loads from valid cache lines happen without bus transaction and state change
-    if (request.type == Architecture::INSTRUCTION_TYPE::LOAD) {
-      if (cacheLine.state == SHARED_CLEAN || cacheLine.state == SHARED_MODIFIED) {
-        ++Architecture::GlobalReport::numSharedAccess;
-      }
-      else {
-        ++Architecture::GlobalReport::numPrivateAccess;
-      }
-
-      cacheLine.lastUsed = Architecture::GlobalCycleCounter::getCounter(); // set last used to now
-      m_executingNonBusRequests.emplace_back(request, L1_CACHE_HIT_CYCLES);
-      return;
-    }
-
-    // Exclusive/Modified State Store Request: can write and return immediately
-    if (cacheLine.state == EXCLUSIVE || cacheLine.state == MODIFIED) {
-      ++Architecture::GlobalReport::numPrivateAccess;
-
-      cacheLine.lastUsed = Architecture::GlobalCycleCounter::getCounter(); // set last used to now
-      m_executingNonBusRequests.emplace_back(request, L1_CACHE_HIT_CYCLES);
+    ++m_report.numCacheHits[request.coreNum];
+
+    CacheLineRef cacheLine = getCacheLine(request.coreNum, setIdx, blockIdx);
+    // Load Request or Exclusive/Modified State Store Request: can return immediately
+    if (request.type == Architecture::INSTRUCTION_TYPE::LOAD || cacheLine.state == EXCLUSIVE || cacheLine.state == MODIFIED) {
+      updateOnLocalHit(request, cacheLine);
+      profileAccess(request, cacheLine);
+      m_executingNonBusRequests.schedule(request, L1_CACHE_HIT_CYCLES);
       return;
     }
 
     // Shared_Clean/Shared_Modified State Store Request: Need to update all other cache lines through bus transaction, add to bus transaction queue
-    m_queuedBusTransactions.emplace(request, setIdx, blockIdx);
+    enqueueBusTransaction(request, setIdx, blockIdx);
     return;
   }
 
   ////// not in cache //////
-  ++Architecture::GlobalReport::numCacheMisses[request.coreNum];
+  ++m_report.numCacheMisses[request.coreNum];
 
   blockIdx = findBlockIdxToReplace(request.coreNum, setIdx);
-  CacheLine& cacheLine = m_l1Caches[request.coreNum][setIdx][blockIdx];
+  CacheLineRef cacheLine = getCacheLine(request.coreNum, setIdx, blockIdx);
   // We evict the cache line and prepare to load in the new cache line through a bus transaction
   int startingCycles = 0;
-  if (cacheLine.state == MODIFIED) { // if modified, we need to write back the dirty cache line first, so we add the cycles to the initial cycles needed
-    startingCycles += getAndLog_L1_CACHE_WRITE_BACK_CYCLES();
+  if (cacheLine.state != INVALID) { // if modified, we need to write back the dirty cache line first, so we add the cycles to the initial cycles needed
+    startingCycles += evictL1Line(request.coreNum, m_geometry.getBlockAddress(cacheLine.tag, setIdx), cacheLine.state == MODIFIED);
   }
-  cacheLine.tag = getTag(request.address); // set tag
+  cacheLine.tag = m_geometry.getTag(request.address); // set tag
   cacheLine.state = INVALID; // set state
-  cacheLine.lastUsed = Architecture::GlobalCycleCounter::getCounter(); // set last used to now
+  insertLine(request.coreNum, cacheLine);
   // Enqueue bus transaction
-  m_queuedBusTransactions.emplace(request, setIdx, blockIdx, startingCycles);
+  enqueueBusTransaction(request, setIdx, blockIdx, startingCycles);
+}
+
+void DragonMemorySystem::updateOnLocalHit(const MemoryRequest& request, CacheLineRef cacheLine) {
+  // Load Request: All loads from valid cache lines happen without bus transaction and state change
+  if (request.type == Architecture::INSTRUCTION_TYPE::LOAD) {
+    if (cacheLine.state == SHARED_CLEAN || cacheLine.state == SHARED_MODIFIED) {
+      ++m_report.numSharedAccess;
+    }
+    else {
+      ++m_report.numPrivateAccess;
+    }
+    touchLine(request.coreNum, cacheLine);
+    return;
+  }
+
+  // Exclusive/Modified State Store Request: can write and return immediately
+  ++m_report.numPrivateAccess;
+  touchLine(request.coreNum, cacheLine);
 }
 
 void DragonMemorySystem::processBusTransaction(BusTransaction& transaction) {
   int initiatingCoreIdx = transaction.request.coreNum;
-  CacheLine& cacheLine = m_l1Caches[initiatingCoreIdx][transaction.setIdx][transaction.blockIdx];
+  CacheLineRef cacheLine = getCacheLine(initiatingCoreIdx, transaction.setIdx, transaction.blockIdx);
 
   // Load only issues bus transaction if loading from Invalid state
   if (transaction.request.type == Architecture::LOAD) {
     // check other caches for a valid copy of the cache line
     bool foundOtherCopy = false;
-    for (int otherCoreIdx = 0; otherCoreIdx < Architecture::NUM_CORES; ++otherCoreIdx) {
-      if (otherCoreIdx == initiatingCoreIdx) continue; // dont check self
-      auto [otherSetIdx, otherBlockIdx] = findInCache(otherCoreIdx, transaction.request.address);
+    for (int otherCoreIdx : getSnoopTargets(initiatingCoreIdx, transaction.request.address)) {
+      auto [otherSetIdx, otherBlockIdx] = snoopCache(otherCoreIdx, transaction.request.address);
       if (otherBlockIdx == INVALID_BLOCK_IDX) continue; // not in the other cache, continue
       
       // Cache line found in other cache
-      ++Architecture::GlobalReport::numSharedAccess;
+      ++m_report.numSharedAccess;
       foundOtherCopy = true;
-      CacheLine& otherCacheLine = m_l1Caches[otherCoreIdx][otherSetIdx][otherBlockIdx]; // get other cache line
+      CacheLineRef otherCacheLine = getCacheLine(otherCoreIdx, otherSetIdx, otherBlockIdx); // get other cache line
 
       // Other cache has modified cache line, need to flush and go to shared modified
       if (otherCacheLine.state == SHARED_MODIFIED || otherCacheLine.state == MODIFIED) {
-        transaction.remainingCycles += getAndLog_L1_CACHE_WRITE_BACK_CYCLES();
+        transaction.remainingCycles += getAndLog_L1_CACHE_WRITE_BACK_CYCLES(m_geometry.getBlockAddress(transaction.request.address));
         otherCacheLine.state = SHARED_MODIFIED;
       }
 
@@ -411,31 +1224,30 @@ void DragonMemorySystem::processBusTransaction(BusTransaction& transaction) {
 
     // didnt find other copy, need to load from memory
     if (!foundOtherCopy) {
-      ++Architecture::GlobalReport::numPrivateAccess;
+      ++m_report.numPrivateAccess;
 
       cacheLine.state = EXCLUSIVE; // transition self state to exclusive
-      transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_FROM_MEM_CYCLES() + L1_CACHE_HIT_CYCLES;
+      transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_FROM_MEM_CYCLES(transaction.request.address) + L1_CACHE_HIT_CYCLES;
     }
   }
 
   // Store issues bus transaction when storing from invalid or shared state
   else {
-    ++Architecture::GlobalReport::busInvalidationsOrUpdates;
+    ++m_report.busInvalidationsOrUpdates;
 
     // There could be other caches holding this line, need to invalidate all of them first
     bool foundOtherCopy = false;
     bool hasCacheLine = cacheLine.state != INVALID;
-    for (int otherCoreIdx = 0; otherCoreIdx < Architecture::NUM_CORES; ++otherCoreIdx) {
-      if (otherCoreIdx == initiatingCoreIdx) continue; // dont check self
-      auto [otherSetIdx, otherBlockIdx] = findInCache(otherCoreIdx, transaction.request.address);
+    for (int otherCoreIdx : getSnoopTargets(initiatingCoreIdx, transaction.request.address)) {
+      auto [otherSetIdx, otherBlockIdx] = snoopCache(otherCoreIdx, transaction.request.address);
       if (otherBlockIdx == INVALID_BLOCK_IDX) continue; // not in the other cache, continue
 
       // Cache line found in other cache
       foundOtherCopy = true;
-      CacheLine& otherCacheLine = m_l1Caches[otherCoreIdx][otherSetIdx][otherBlockIdx]; // get other cache line
+      CacheLineRef otherCacheLine = getCacheLine(otherCoreIdx, otherSetIdx, otherBlockIdx); // get other cache line
 
       if (otherCacheLine.state == SHARED_MODIFIED || otherCacheLine.state == MODIFIED) { // Other cache line is modified, need to flush
-        transaction.remainingCycles += getAndLog_L1_CACHE_WRITE_BACK_CYCLES();
+        transaction.remainingCycles += getAndLog_L1_CACHE_WRITE_BACK_CYCLES(m_geometry.getBlockAddress(transaction.request.address));
       }
 
       if (!hasCacheLine) { // if we dont have the cache line, we need to get it from other cache
@@ -445,15 +1257,16 @@ void DragonMemorySystem::processBusTransaction(BusTransaction& transaction) {
 
       otherCacheLine.state = SHARED_CLEAN; // other cache line needs to go to shared clean regardless of state
       transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_WORD_FROM_BUS_CYCLES(); // Perform write update to the other cache
+      profileRemoteWrite(transaction.request.address, otherCoreIdx, otherCacheLine, true);
     }
 
     // Log Memory Access Type
-    if (foundOtherCopy) ++Architecture::GlobalReport::numSharedAccess;
-    else ++Architecture::GlobalReport::numPrivateAccess;
+    if (foundOtherCopy) ++m_report.numSharedAccess;
+    else ++m_report.numPrivateAccess;
 
     // no cache(including us) has the cache line, we need to get the cache line from memory
     if (!hasCacheLine) {
-      transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_FROM_MEM_CYCLES();
+      transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_FROM_MEM_CYCLES(transaction.request.address);
     }
 
     // We found no other valid cache line, hence safe to enter modified
@@ -468,6 +1281,7 @@ void DragonMemorySystem::processBusTransaction(BusTransaction& transaction) {
     transaction.remainingCycles += L1_CACHE_HIT_CYCLES; // 1 cycle writing into cache
   }
 
+  addToSnoopFilter(initiatingCoreIdx, m_geometry.getBlockAddress(transaction.request.address)); // initiating core now holds a valid copy
   transaction.processed = true; // set to processed 
 }
 
@@ -475,71 +1289,73 @@ void MOESIMemorySystem::handleIncomingRequest(const MemoryRequest& request) {
   auto [setIdx, blockIdx] = findInCache(request.coreNum, request.address);
   ////// in cache //////
   if (blockIdx != INVALID_BLOCK_IDX) {
-    ++Architecture::GlobalReport::numCacheHits[request.coreNum];
-
-    CacheLine& cacheLine = m_l1Caches[request.coreNum][setIdx][blockIdx];
-    // Load Request: All loads from valid cache lines happen without bus transaction and state change
-    if (request.type == Architecture::INSTRUCTION_TYPE::LOAD) {
-      if (cacheLine.state == SHARED || cacheLine.state == OWNED) {
-        ++Architecture::GlobalReport::numSharedAccess;
-      } else {
-        ++Architecture::GlobalReport::numPrivateAccess;
-      }
-
-      cacheLine.lastUsed = Architecture::GlobalCycleCounter::getCounter(); // set last used to now
-      m_executingNonBusRequests.emplace_back(request, L1_CACHE_HIT_CYCLES);
-      return;
-    }
-
-    // Exclusive/Modified State Store Request: can write and return immediately
-    if (cacheLine.state == EXCLUSIVE || cacheLine.state == MODIFIED) {
-      ++Architecture::GlobalReport::numPrivateAccess;
-
-      cacheLine.state = MODIFIED; // write changes exclusive to modified state, modified stays as modified
-      cacheLine.lastUsed = Architecture::GlobalCycleCounter::getCounter(); // set last used to now
-      m_executingNonBusRequests.emplace_back(request, L1_CACHE_HIT_CYCLES);
+    ++m_report.numCacheHits[request.coreNum];
+
+    CacheLineRef cacheLine = getCacheLine(request.coreNum, setIdx, blockIdx);
+    // Load Request or Exclusive/Modified State Store Request: can return immediately
+    if (request.type == Architecture::INSTRUCTION_TYPE::LOAD || cacheLine.state == EXCLUSIVE || cacheLine.state == MODIFIED) {
+      updateOnLocalHit(request, cacheLine);
+      profileAccess(request, cacheLine);
+      m_executingNonBusRequests.schedule(request, L1_CACHE_HIT_CYCLES);
       return;
     }
 
     // Shared/Owned State Store Request: Need to invalidate all other cache lines through bus transaction, add to bus transaction queue
-    m_queuedBusTransactions.emplace(request, setIdx, blockIdx);
+    enqueueBusTransaction(request, setIdx, blockIdx);
     return;
   }
 
   ////// not in cache //////
-  ++Architecture::GlobalReport::numCacheMisses[request.coreNum];
+  ++m_report.numCacheMisses[request.coreNum];
 
   blockIdx = findBlockIdxToReplace(request.coreNum, setIdx);
-  CacheLine& cacheLine = m_l1Caches[request.coreNum][setIdx][blockIdx];
+  CacheLineRef cacheLine = getCacheLine(request.coreNum, setIdx, blockIdx);
   // We evict the cache line and prepare to load in the new cache line through a bus transaction
   int startingCycles = 0;
-  if (cacheLine.state == MODIFIED || cacheLine.state == OWNED) { // if modified or owned, we need to write back the dirty cache line first, so we add the cycles to the initial cycles needed
-    startingCycles += getAndLog_L1_CACHE_WRITE_BACK_CYCLES();
+  if (cacheLine.state != INVALID) { // if modified or owned, we need to write back the dirty cache line first, so we add the cycles to the initial cycles needed
+    startingCycles += evictL1Line(request.coreNum, m_geometry.getBlockAddress(cacheLine.tag, setIdx), cacheLine.state == MODIFIED || cacheLine.state == OWNED);
   }
-  cacheLine.tag = getTag(request.address); // set tag
+  cacheLine.tag = m_geometry.getTag(request.address); // set tag
   cacheLine.state = INVALID; // set state
-  cacheLine.lastUsed = Architecture::GlobalCycleCounter::getCounter(); // set last used to now
+  insertLine(request.coreNum, cacheLine);
   // Enqueue bus transaction
-  m_queuedBusTransactions.emplace(request, setIdx, blockIdx, startingCycles);
+  enqueueBusTransaction(request, setIdx, blockIdx, startingCycles);
+}
+
+void MOESIMemorySystem::updateOnLocalHit(const MemoryRequest& request, CacheLineRef cacheLine) {
+  // Load Request: All loads from valid cache lines happen without bus transaction and state change
+  if (request.type == Architecture::INSTRUCTION_TYPE::LOAD) {
+    if (cacheLine.state == SHARED || cacheLine.state == OWNED) {
+      ++m_report.numSharedAccess;
+    } else {
+      ++m_report.numPrivateAccess;
+    }
+    touchLine(request.coreNum, cacheLine);
+    return;
+  }
+
+  // Exclusive/Modified State Store Request: can write and return immediately
+  ++m_report.numPrivateAccess;
+  cacheLine.state = MODIFIED; // write changes exclusive to modified state, modified stays as modified
+  touchLine(request.coreNum, cacheLine);
 }
 
 void MOESIMemorySystem::processBusTransaction(BusTransaction& transaction) {
   int initiatingCoreIdx = transaction.request.coreNum;
-  CacheLine& cacheLine = m_l1Caches[initiatingCoreIdx][transaction.setIdx][transaction.blockIdx];
+  CacheLineRef cacheLine = getCacheLine(initiatingCoreIdx, transaction.setIdx, transaction.blockIdx);
   
   // Load only issues bus transaction if loading from Invalid state
   if (transaction.request.type == Architecture::LOAD) {
     // check other caches for a valid copy of the cache line
     bool foundOtherCopy = false;
-    for (int otherCoreIdx = 0; otherCoreIdx < Architecture::NUM_CORES; ++otherCoreIdx) {
-      if (otherCoreIdx == initiatingCoreIdx) continue; // dont check self
-      auto [otherSetIdx, otherBlockIdx] = findInCache(otherCoreIdx, transaction.request.address);
+    for (int otherCoreIdx : getSnoopTargets(initiatingCoreIdx, transaction.request.address)) {
+      auto [otherSetIdx, otherBlockIdx] = snoopCache(otherCoreIdx, transaction.request.address);
       if (otherBlockIdx == INVALID_BLOCK_IDX) continue; // not in the other cache, continue
       
       // Cache line found in other cache
-      ++Architecture::GlobalReport::numSharedAccess;
+      ++m_report.numSharedAccess;
       foundOtherCopy = true;
-      CacheLine& otherCacheLine = m_l1Caches[otherCoreIdx][otherSetIdx][otherBlockIdx]; // get other cache line
+      CacheLineRef otherCacheLine = getCacheLine(otherCoreIdx, otherSetIdx, otherBlockIdx); // get other cache line
 
       // NOTE: FALLTHROUGHS HERE ARE INTENTIONAL FOR THE LOGIC
       CACHELINE_STATE newOtherState = SHARED;
@@ -568,55 +1384,496 @@ void MOESIMemorySystem::processBusTransaction(BusTransaction& transaction) {
 
     // didnt find other copy, need to load from memory
     if (!foundOtherCopy) {
-      ++Architecture::GlobalReport::numPrivateAccess;
+      ++m_report.numPrivateAccess;
 
       cacheLine.state = EXCLUSIVE; // transition self state to exclusive
-      transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_FROM_MEM_CYCLES() + L1_CACHE_HIT_CYCLES;
+      transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_FROM_MEM_CYCLES(transaction.request.address) + L1_CACHE_HIT_CYCLES;
     }
   } 
 
   // Store issues bus transaction when storing from invalid, shared or owned state
   else {
-    ++Architecture::GlobalReport::busInvalidationsOrUpdates;
+    ++m_report.busInvalidationsOrUpdates;
 
     // There could be other caches holding this line, need to invalidate all of them first
     bool foundOtherCopy = false;
     bool hasCacheLine = cacheLine.state != INVALID;
-    for (int otherCoreIdx = 0; otherCoreIdx < Architecture::NUM_CORES; ++otherCoreIdx) {
-      if (otherCoreIdx == initiatingCoreIdx) continue; // dont check self
-      auto [otherSetIdx, otherBlockIdx] = findInCache(otherCoreIdx, transaction.request.address);
+    for (int otherCoreIdx : getSnoopTargets(initiatingCoreIdx, transaction.request.address)) {
+      auto [otherSetIdx, otherBlockIdx] = snoopCache(otherCoreIdx, transaction.request.address);
       if (otherBlockIdx == INVALID_BLOCK_IDX) continue; // not in the other cache, continue
 
       // Cache line found in other cache
       foundOtherCopy = true;
-      CacheLine& otherCacheLine = m_l1Caches[otherCoreIdx][otherSetIdx][otherBlockIdx]; // get other cache line
+      CacheLineRef otherCacheLine = getCacheLine(otherCoreIdx, otherSetIdx, otherBlockIdx); // get other cache line
 
       // // MOESI does not write back when sharing data
       // if (otherCacheLine.state == MODIFIED || otherCacheLine.state == OWNED) { // The other cache line is dirty, we need to write it back to memory
-      //   transaction.remainingCycles += getAndLog_L1_CACHE_WRITE_BACK_CYCLES();
+      //   transaction.remainingCycles += getAndLog_L1_CACHE_WRITE_BACK_CYCLES(m_geometry.getBlockAddress(transaction.request.address));
       // }
 
       if (!hasCacheLine) { // if we dont have the cache line, we need to get the block from other cache line
         transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_BLOCK_FROM_BUS_CYCLES();
         hasCacheLine = true;
       }
+      profileRemoteWrite(transaction.request.address, otherCoreIdx, otherCacheLine, false);
       otherCacheLine.state = INVALID; // invalidate other cache line
+      removeFromSnoopFilter(otherCoreIdx, m_geometry.getBlockAddress(transaction.request.address));
     }
 
     // Log Memory Access Type
-    if (foundOtherCopy) ++Architecture::GlobalReport::numSharedAccess;
-    else ++Architecture::GlobalReport::numPrivateAccess;
+    if (foundOtherCopy) ++m_report.numSharedAccess;
+    else ++m_report.numPrivateAccess;
 
     // no cache(including us) has the cache line, we need to get the cache line from memory
     if (!hasCacheLine) {
-      transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_FROM_MEM_CYCLES();
+      transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_FROM_MEM_CYCLES(transaction.request.address);
     }
     
     cacheLine.state = MODIFIED; // set self to modified state
     transaction.remainingCycles += L1_CACHE_HIT_CYCLES; // 1 cycle writing into cache
   }
 
+  addToSnoopFilter(initiatingCoreIdx, m_geometry.getBlockAddress(transaction.request.address)); // initiating core now holds a valid copy
   transaction.processed = true; // set to processed 
 }
 
+HybridMemorySystem::HybridMemorySystem(const CacheGeometry& geometry, const int numCores, const MemorySystemConfig& config, Architecture::GlobalReport& report, const Architecture::GlobalCycleCounter& cycleCounter)
+    : DragonMemorySystem(geometry, numCores, config, report, cycleCounter), m_updateThreshold(config.hybridUpdateThreshold),
+      m_updatesSinceAccessByCore(numCores, std::vector<uint8_t>(geometry.numBlocks, 0)) {
+  m_report.hybridUpdateThreshold = m_updateThreshold;
+}
+
+void HybridMemorySystem::updateOnLocalHit(const MemoryRequest& request, CacheLineRef cacheLine) {
+  getUpdatesSinceAccess(request.coreNum, cacheLine) = 0;
+  DragonMemorySystem::updateOnLocalHit(request, cacheLine);
+}
+
+void HybridMemorySystem::processBusTransaction(BusTransaction& transaction) {
+  int initiatingCoreIdx = transaction.request.coreNum;
+  CacheLineRef cacheLine = getCacheLine(initiatingCoreIdx, transaction.setIdx, transaction.blockIdx);
+  getUpdatesSinceAccess(initiatingCoreIdx, cacheLine) = 0;
+
+  // Loads are the same as Dragon, other copies are not accessed by their own cores so keep their counts
+  if (transaction.request.type == Architecture::LOAD) {
+    DragonMemorySystem::processBusTransaction(transaction);
+    return;
+  }
+
+  ++m_report.busInvalidationsOrUpdates;
+
+  // Update each other copy, or invalidate it if it has been updated too often without being accessed
+  bool foundOtherCopy = false;
+  bool hasCacheLine = cacheLine.state != INVALID;
+  uint8_t blockModes = 0;
+  int numUpdatedCopies = 0;
+  const uint64_t blockAddress = m_geometry.getBlockAddress(transaction.request.address);
+  for (int otherCoreIdx : getSnoopTargets(initiatingCoreIdx, transaction.request.address)) {
+    auto [otherSetIdx, otherBlockIdx] = snoopCache(otherCoreIdx, transaction.request.address);
+    if (otherBlockIdx == INVALID_BLOCK_IDX) continue; // not in the other cache, continue
+
+    // Cache line found in other cache
+    foundOtherCopy = true;
+    CacheLineRef otherCacheLine = getCacheLine(otherCoreIdx, otherSetIdx, otherBlockIdx); // get other cache line
+
+    if (otherCacheLine.state == SHARED_MODIFIED || otherCacheLine.state == MODIFIED) { // Other cache line is modified, need to flush
+      transaction.remainingCycles += getAndLog_L1_CACHE_WRITE_BACK_CYCLES(blockAddress);
+    }
+
+    if (!hasCacheLine) { // if we dont have the cache line, we need to get it from other cache
+      transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_BLOCK_FROM_BUS_CYCLES();
+      hasCacheLine = true;
+    }
+
+    uint8_t& updatesSinceAccess = getUpdatesSinceAccess(otherCoreIdx, otherCacheLine);
+    if (++updatesSinceAccess >= m_updateThreshold) {
+      profileRemoteWrite(transaction.request.address, otherCoreIdx, otherCacheLine, false);
+      otherCacheLine.state = INVALID; // invalidate other cache line
+      removeFromSnoopFilter(otherCoreIdx, blockAddress);
+      ++m_report.numHybridInvalidatedCopies;
+      blockModes |= INVALIDATE_MODE;
+    } else {
+      otherCacheLine.state = SHARED_CLEAN; // other cache line needs to go to shared clean regardless of state
+      transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_WORD_FROM_BUS_CYCLES(); // Perform write update to the other cache
+      profileRemoteWrite(transaction.request.address, otherCoreIdx, otherCacheLine, true);
+      ++m_report.numHybridUpdatedCopies;
+      ++numUpdatedCopies;
+      blockModes |= UPDATE_MODE;
+    }
+  }
+
+  // Log Memory Access Type
+  if (foundOtherCopy) ++m_report.numSharedAccess;
+  else ++m_report.numPrivateAccess;
+
+  // no cache(including us) has the cache line, we need to get the cache line from memory
+  if (!hasCacheLine) {
+    transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_FROM_MEM_CYCLES(transaction.request.address);
+  }
+
+  // Shared modified only while a copy is left to update
+  cacheLine.state = (numUpdatedCopies > 0) ? SHARED_MODIFIED : MODIFIED;
+  transaction.remainingCycles += L1_CACHE_HIT_CYCLES; // 1 cycle writing into cache
+
+  if (blockModes & UPDATE_MODE) logBlockMode(blockAddress, UPDATE_MODE);
+  if (blockModes & INVALIDATE_MODE) logBlockMode(blockAddress, INVALIDATE_MODE);
+  addToSnoopFilter(initiatingCoreIdx, blockAddress); // initiating core now holds a valid copy
+  transaction.processed = true; // set to processed
+}
+
+void HybridMemorySystem::logBlockMode(const uint64_t blockAddress, const uint8_t mode) {
+  uint8_t& modes = m_blockModes[blockAddress];
+  if (modes & mode) {
+    return;
+  }
+  if (modes == 0) {
+    ++(mode == UPDATE_MODE ? m_report.numHybridUpdateLines : m_report.numHybridInvalidateLines);
+  } else { // ran in the other mode before
+    --(mode == UPDATE_MODE ? m_report.numHybridInvalidateLines : m_report.numHybridUpdateLines);
+    ++m_report.numHybridSwitchedLines;
+  }
+  modes |= mode;
+}
+
+void MesifMemorySystem::updateOnLocalHit(const MemoryRequest& request, CacheLineRef cacheLine) {
+  // Forward is a shared state that only differs in answering the next read miss
+  if (request.type == Architecture::INSTRUCTION_TYPE::LOAD && cacheLine.state == FORWARD) {
+    ++m_report.numSharedAccess;
+    touchLine(request.coreNum, cacheLine);
+    return;
+  }
+  MesiMemorySystem::updateOnLocalHit(request, cacheLine);
+}
+
+void MesifMemorySystem::processBusTransaction(BusTransaction& transaction) {
+  int initiatingCoreIdx = transaction.request.coreNum;
+  CacheLineRef cacheLine = getCacheLine(initiatingCoreIdx, transaction.setIdx, transaction.blockIdx);
+  const uint64_t blockAddress = m_geometry.getBlockAddress(transaction.request.address);
+
+  // Load only issues bus transaction if loading from Invalid state
+  if (transaction.request.type == Architecture::LOAD) {
+    // look for the one copy that responds, plain shared copies stay silent
+    bool foundOtherCopy = false;
+    bool foundResponder = false;
+    for (int otherCoreIdx : getSnoopTargets(initiatingCoreIdx, transaction.request.address)) {
+      auto [otherSetIdx, otherBlockIdx] = snoopCache(otherCoreIdx, transaction.request.address);
+      if (otherBlockIdx == INVALID_BLOCK_IDX) continue; // not in the other cache, continue
+
+      foundOtherCopy = true;
+      CacheLineRef otherCacheLine = getCacheLine(otherCoreIdx, otherSetIdx, otherBlockIdx); // get other cache line
+      if (otherCacheLine.state == SHARED) continue;
+
+      if (otherCacheLine.state == MODIFIED) { // we need to write back the dirty cache line
+        transaction.remainingCycles += getAndLog_L1_CACHE_WRITE_BACK_CYCLES(blockAddress);
+      }
+      transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_BLOCK_FROM_BUS_CYCLES() + L1_CACHE_HIT_CYCLES; // get block from the responder
+      otherCacheLine.state = SHARED; // forwarding passes to the requester
+      foundResponder = true;
+      break; // there is at most one responder
+    }
+
+    if (foundOtherCopy) {
+      ++m_report.numSharedAccess;
+      cacheLine.state = FORWARD;
+    } else {
+      ++m_report.numPrivateAccess;
+      cacheLine.state = EXCLUSIVE;
+    }
+    if (!foundResponder) { // no copy, or only shared copies after the forwarding copy was evicted
+      transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_FROM_MEM_CYCLES(transaction.request.address) + L1_CACHE_HIT_CYCLES;
+    }
+  }
+
+  // Store issues bus transaction when storing from invalid, shared or forward state
+  else {
+    ++m_report.busInvalidationsOrUpdates;
+
+    // Invalidate every other copy, only the responder supplies the block if we do not have it
+    bool foundOtherCopy = false;
+    bool hasCacheLine = cacheLine.state != INVALID;
+    for (int otherCoreIdx : getSnoopTargets(initiatingCoreIdx, transaction.request.address)) {
+      auto [otherSetIdx, otherBlockIdx] = snoopCache(otherCoreIdx, transaction.request.address);
+      if (otherBlockIdx == INVALID_BLOCK_IDX) continue; // not in the other cache, continue
+
+      foundOtherCopy = true;
+      CacheLineRef otherCacheLine = getCacheLine(otherCoreIdx, otherSetIdx, otherBlockIdx); // get other cache line
+
+      if (otherCacheLine.state == MODIFIED) { // The other cache line is dirty, we need to write it back to memory
+        transaction.remainingCycles += getAndLog_L1_CACHE_WRITE_BACK_CYCLES(blockAddress);
+      }
+
+      if (!hasCacheLine && otherCacheLine.state != SHARED) { // the responder supplies the block
+        transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_BLOCK_FROM_BUS_CYCLES();
+        hasCacheLine = true;
+      }
+      profileRemoteWrite(transaction.request.address, otherCoreIdx, otherCacheLine, false);
+      otherCacheLine.state = INVALID; // invalidate other cache line
+      removeFromSnoopFilter(otherCoreIdx, blockAddress);
+    }
+
+    // Log Memory Access Type
+    if (foundOtherCopy) ++m_report.numSharedAccess;
+    else ++m_report.numPrivateAccess;
+
+    // no responder (including us) has the cache line, we need to get the cache line from memory
+    if (!hasCacheLine) {
+      transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_FROM_MEM_CYCLES(transaction.request.address);
+    }
+
+    cacheLine.state = MODIFIED; // set self to modified state
+    transaction.remainingCycles += L1_CACHE_HIT_CYCLES; // 1 cycle writing into cache
+  }
+
+  addToSnoopFilter(initiatingCoreIdx, blockAddress); // initiating core now holds a valid copy
+  transaction.processed = true; // set to processed
+}
+
+void MsiMemorySystem::processBusTransaction(BusTransaction& transaction) {
+  int initiatingCoreIdx = transaction.request.coreNum;
+  CacheLineRef cacheLine = getCacheLine(initiatingCoreIdx, transaction.setIdx, transaction.blockIdx);
+  const uint64_t blockAddress = m_geometry.getBlockAddress(transaction.request.address);
+
+  // Load only issues bus transaction if loading from Invalid state
+  if (transaction.request.type == Architecture::LOAD) {
+    bool foundOtherCopy = false;
+    bool foundOwner = false;
+    for (int otherCoreIdx : getSnoopTargets(initiatingCoreIdx, transaction.request.address)) {
+      auto [otherSetIdx, otherBlockIdx] = snoopCache(otherCoreIdx, transaction.request.address);
+      if (otherBlockIdx == INVALID_BLOCK_IDX) continue; // not in the other cache, continue
+
+      foundOtherCopy = true;
+      CacheLineRef otherCacheLine = getCacheLine(otherCoreIdx, otherSetIdx, otherBlockIdx); // get other cache line
+      if (otherCacheLine.state == MODIFIED) { // the owner writes back and supplies the block, then is the only copy
+        transaction.remainingCycles += getAndLog_L1_CACHE_WRITE_BACK_CYCLES(blockAddress);
+        transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_BLOCK_FROM_BUS_CYCLES() + L1_CACHE_HIT_CYCLES;
+        otherCacheLine.state = SHARED;
+        foundOwner = true;
+        break;
+      }
+    }
+
+    if (foundOtherCopy) ++m_report.numSharedAccess;
+    else ++m_report.numPrivateAccess;
+    if (!foundOwner) {
+      transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_FROM_MEM_CYCLES(transaction.request.address) + L1_CACHE_HIT_CYCLES;
+    }
+    cacheLine.state = SHARED; // no exclusive state, even without other copies
+  }
+
+  // Store issues bus transaction when storing from invalid or shared state
+  else {
+    ++m_report.busInvalidationsOrUpdates;
+
+    bool foundOtherCopy = false;
+    bool hasCacheLine = cacheLine.state != INVALID;
+    for (int otherCoreIdx : getSnoopTargets(initiatingCoreIdx, transaction.request.address)) {
+      auto [otherSetIdx, otherBlockIdx] = snoopCache(otherCoreIdx, transaction.request.address);
+      if (otherBlockIdx == INVALID_BLOCK_IDX) continue; // not in the other cache, continue
+
+      foundOtherCopy = true;
+      CacheLineRef otherCacheLine = getCacheLine(otherCoreIdx, otherSetIdx, otherBlockIdx); // get other cache line
+
+      if (otherCacheLine.state == MODIFIED) { // The owner writes back, and supplies the block if we do not have it
+        transaction.remainingCycles += getAndLog_L1_CACHE_WRITE_BACK_CYCLES(blockAddress);
+        if (!hasCacheLine) {
+          transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_BLOCK_FROM_BUS_CYCLES();
+          hasCacheLine = true;
+        }
+      }
+      profileRemoteWrite(transaction.request.address, otherCoreIdx, otherCacheLine, false);
+      otherCacheLine.state = INVALID; // invalidate other cache line
+      removeFromSnoopFilter(otherCoreIdx, blockAddress);
+    }
+
+    // Log Memory Access Type
+    if (foundOtherCopy) ++m_report.numSharedAccess;
+    else ++m_report.numPrivateAccess;
+
+    // no owner (including us) has the cache line, we need to get the cache line from memory
+    if (!hasCacheLine) {
+      transaction.remainingCycles += getAndLog_L1_CACHE_LOAD_FROM_MEM_CYCLES(transaction.request.address);
+    }
+
+    cacheLine.state = MODIFIED; // set self to modified state
+    transaction.remainingCycles += L1_CACHE_HIT_CYCLES; // 1 cycle writing into cache
+  }
+
+  addToSnoopFilter(initiatingCoreIdx, blockAddress); // initiating core now holds a valid copy
+  transaction.processed = true; // set to processed
+}
+
+namespace {
+  // Mesh dimensions left at 0 fit the cores into the squarest mesh
+  Mesh::MeshConfig fitMesh(Mesh::MeshConfig mesh, const int numCores) {
+    if (mesh.width == 0 || mesh.height == 0) {
+      Mesh::chooseDimensions(numCores, mesh.width, mesh.height);
+    }
+    return mesh;
+  }
+}
+
+DirectoryMemorySystem::DirectoryMemorySystem(const CacheGeometry& geometry, const int numCores, const MemorySystemConfig& config, Architecture::GlobalReport& report, const Architecture::GlobalCycleCounter& cycleCounter)
+    : MesiMemorySystem(geometry, numCores, config, report, cycleCounter), m_mesh(fitMesh(config.mesh, numCores), report) {
+  if (!m_snoopFilterPtr) {
+    m_snoopFilterPtr = std::make_unique<SnoopFilter>(numCores); // the directory entries
+  }
+  m_report.snoopFilterEnabled = true;
+  m_homeQueues.resize(m_mesh.getNumNodes());
+  m_usesBus = false;
+  if (!config.quiet) {
+    printf("Initialised a directory at each node of a %dx%d mesh.\n", m_report.meshWidth, m_report.meshHeight);
+  }
+}
+
+void DirectoryMemorySystem::processBusTransaction(BusTransaction& transaction) {
+  const int initiatingCoreIdx = transaction.request.coreNum;
+  CacheLineRef cacheLine = getCacheLine(initiatingCoreIdx, transaction.setIdx, transaction.blockIdx);
+  const uint64_t blockAddress = m_geometry.getBlockAddress(transaction.request.address);
+  const int dataMessageBytes = Mesh::CONTROL_MESSAGE_BYTES + m_geometry.blockSize;
+  const long long now = m_cycleCounter.getCounter();
+  const int homeNode = getHomeNode(transaction.request.address);
+
+  // Request travels to the home node, whose directory knows every copy
+  const long long lookupCycle = m_mesh.send(initiatingCoreIdx, homeNode, Mesh::CONTROL_MESSAGE_BYTES, now) + DIRECTORY_LOOKUP_CYCLES;
+  long long arrivalCycle = lookupCycle; // last message needed by the requester
+  bool foundOtherCopy = false;
+  bool hasCacheLine = cacheLine.state != INVALID;
+  const bool isLoad = transaction.request.type == Architecture::LOAD;
+  if (!isLoad) {
+    ++m_report.busInvalidationsOrUpdates;
+  }
+
+  for (int otherCoreIdx : getSnoopTargets(initiatingCoreIdx, transaction.request.address)) {
+    auto [otherSetIdx, otherBlockIdx] = snoopCache(otherCoreIdx, transaction.request.address);
+    if (otherBlockIdx == INVALID_BLOCK_IDX) continue; // evicted since the directory was told
+
+    foundOtherCopy = true;
+    CacheLineRef otherCacheLine = getCacheLine(otherCoreIdx, otherSetIdx, otherBlockIdx); // get other cache line
+    const bool isOwner = otherCacheLine.state == MODIFIED || otherCacheLine.state == EXCLUSIVE;
+    if (isLoad && !isOwner) continue; // shared copies are left alone by loads
+
+    // Owner is forwarded the request, shared copies are sent an invalidation
+    const long long snoopCycle = m_mesh.send(homeNode, otherCoreIdx, Mesh::CONTROL_MESSAGE_BYTES, lookupCycle) + L1_CACHE_HIT_CYCLES;
+    if (isOwner && !hasCacheLine) { // owner sends the block straight to the requester
+      getAndLog_L1_CACHE_LOAD_BLOCK_FROM_BUS_CYCLES();
+      arrivalCycle = std::max(arrivalCycle, m_mesh.send(otherCoreIdx, initiatingCoreIdx, dataMessageBytes, snoopCycle));
+      hasCacheLine = true;
+    } else { // acknowledges the invalidation
+      arrivalCycle = std::max(arrivalCycle, m_mesh.send(otherCoreIdx, initiatingCoreIdx, Mesh::CONTROL_MESSAGE_BYTES, snoopCycle));
+    }
+    if (isLoad && otherCacheLine.state == MODIFIED) { // also writes the dirty block back to its home, off the critical path
+      getAndLog_L1_CACHE_WRITE_BACK_CYCLES(blockAddress, m_mesh.send(otherCoreIdx, homeNode, dataMessageBytes, snoopCycle) - now);
+    }
+
+    if (isLoad) {
+      otherCacheLine.state = SHARED;
+    } else { // a modified block passes to the requester without a write back
+      profileRemoteWrite(transaction.request.address, otherCoreIdx, otherCacheLine, false);
+      otherCacheLine.state = INVALID;
+      removeFromSnoopFilter(otherCoreIdx, blockAddress);
+    }
+  }
+
+  // Log Memory Access Type
+  if (foundOtherCopy) ++m_report.numSharedAccess;
+  else ++m_report.numPrivateAccess;
+
+  if (!hasCacheLine) { // home reads the block from memory
+    const long long memoryCycle = lookupCycle + getAndLog_L1_CACHE_LOAD_FROM_MEM_CYCLES(transaction.request.address, lookupCycle - now);
+    arrivalCycle = std::max(arrivalCycle, m_mesh.send(homeNode, initiatingCoreIdx, dataMessageBytes, memoryCycle));
+  } else if (!foundOtherCopy) { // upgrade with no other copies, home grants it
+    arrivalCycle = std::max(arrivalCycle, m_mesh.send(homeNode, initiatingCoreIdx, Mesh::CONTROL_MESSAGE_BYTES, lookupCycle));
+  }
+
+  if (isLoad) {
+    cacheLine.state = foundOtherCopy ? SHARED : EXCLUSIVE;
+  } else {
+    cacheLine.state = MODIFIED;
+  }
+  transaction.remainingCycles += arrivalCycle - now + L1_CACHE_HIT_CYCLES;
+
+  addToSnoopFilter(initiatingCoreIdx, blockAddress); // initiating core now holds a valid copy
+  transaction.processed = true; // set to processed
+}
+
+bool DirectoryMemorySystem::isBlockBusy(const uint64_t address) const {
+  const uint64_t blockAddress = m_geometry.getBlockAddress(address);
+  for (const BusTransaction& transaction : m_inFlightTransactions) {
+    if (m_geometry.getBlockAddress(transaction.request.address) == blockAddress) return true;
+  }
+  return false;
+}
+
+void DirectoryMemorySystem::distributeTransactions() {
+  for (; !m_queuedBusTransactions.empty(); m_queuedBusTransactions.pop()) {
+    const BusTransaction& transaction = m_queuedBusTransactions.front();
+    m_homeQueues[getHomeNode(transaction.request.address)].push(transaction);
+    ++m_numHomeQueued;
+  }
+}
+
+void DirectoryMemorySystem::tickInterconnect(std::vector<MemoryRequest>& completedMemoryRequests) {
+  distributeTransactions();
+  // Prefetches only go out when no directory has a demand request waiting
+  if (m_numHomeQueued == 0 && issueQueuedPrefetch()) {
+    distributeTransactions();
+  }
+
+  for (RingQueue<BusTransaction>& queue : m_homeQueues) {
+    if (queue.empty()) continue;
+    if (isBlockBusy(queue.front().request.address)) { // the block's directory entry is busy until it completes
+      ++m_report.numInFlightBlockStallCycles;
+      continue;
+    }
+    startBusTransaction(queue.front());
+    m_inFlightTransactions.push_back(queue.front());
+    queue.pop();
+    --m_numHomeQueued;
+  }
+
+  for (int i = 0; i < m_inFlightTransactions.size();) {
+    if (--m_inFlightTransactions[i].remainingCycles > 0) {
+      ++i;
+      continue;
+    }
+    const MemoryRequest request = m_inFlightTransactions[i].request;
+    m_inFlightTransactions.erase(m_inFlightTransactions.begin() + i);
+    completeBusTransaction(request, completedMemoryRequests);
+  }
+}
+
+int DirectoryMemorySystem::cyclesUntilInterconnectEvent() const {
+  if (!m_queuedBusTransactions.empty()) {
+    return 0;
+  }
+  bool hasWaitingTransaction = false;
+  for (const RingQueue<BusTransaction>& queue : m_homeQueues) {
+    if (queue.empty()) continue;
+    if (!isBlockBusy(queue.front().request.address)) return 0;
+    hasWaitingTransaction = true;
+  }
+  if (!hasWaitingTransaction && !m_queuedPrefetches.empty()) {
+    return 0;
+  }
+
+  int cycles = std::numeric_limits<int>::max();
+  for (const BusTransaction& transaction : m_inFlightTransactions) {
+    cycles = std::min(cycles, transaction.remainingCycles - 1); // completes on the tick its remaining cycles reach 0
+  }
+  return cycles;
+}
+
+void DirectoryMemorySystem::skipInterconnectCycles(const long long cycles) {
+  for (BusTransaction& transaction : m_inFlightTransactions) {
+    transaction.remainingCycles -= cycles;
+  }
+  for (const RingQueue<BusTransaction>& queue : m_homeQueues) {
+    m_report.numInFlightBlockStallCycles += queue.empty() ? 0 : cycles;
+  }
+}
+
+template void MemorySystem::tickMemorySystem<MemorySystem>(const std::vector<MemoryRequest>&, std::vector<MemoryRequest>&);
+template void MemorySystem::tickMemorySystem<MesiMemorySystem>(const std::vector<MemoryRequest>&, std::vector<MemoryRequest>&);
+template void MemorySystem::tickMemorySystem<DragonMemorySystem>(const std::vector<MemoryRequest>&, std::vector<MemoryRequest>&);
+template void MemorySystem::tickMemorySystem<MOESIMemorySystem>(const std::vector<MemoryRequest>&, std::vector<MemoryRequest>&);
+
 } // namespace
\ No newline at end of file
@@ -1,50 +1,92 @@
 #pragma once
+#include <algorithm>
+#include <array>
 #include <cstdint>
-#include <queue>
+#include <memory>
 #include <string>
+#include <type_traits>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "architecture.h"
+#include "dram.h"
+#include "mesh.h"
+#include "prefetcher.h"
+#include "replacement.h"
+#include "sharing_profiler.h"
 
 namespace Cache {
 constexpr int L1_CACHE_HIT_CYCLES = 1;
 constexpr int L1_CACHE_LOAD_FROM_MEM_CYCLES = 100;
 constexpr int L1_CACHE_WRITE_BACK_CYCLES = 100;
 constexpr int L1_CACHE_LOAD_FROM_BUS_PER_WORD_CYCLES = 2;
+constexpr int SPLIT_BUS_RESPONSE_CYCLES = 1; // returning a block from memory once the bus is released during the access
+constexpr int L2_CACHE_DEFAULT_HIT_CYCLES = 10;
+constexpr int MAX_QUEUED_PREFETCHES = 32; // further prefetches are dropped until the bus catches up
 constexpr char MESI_STRING[] = "MESI";
 constexpr char DRAGON_STRING[] = "DRAGON";
 constexpr char MOESI_STRING[] = "MOESI";
+constexpr char HYBRID_STRING[] = "HYBRID";
+constexpr char MESIF_STRING[] = "MESIF";
+constexpr char MSI_STRING[] = "MSI";
+constexpr char DIRECTORY_STRING[] = "DIRECTORY";
+constexpr int DIRECTORY_LOOKUP_CYCLES = 1;
+constexpr int HYBRID_DEFAULT_UPDATE_THRESHOLD = 4;
 enum COHERENCE_PROTOCOL: uint8_t {
   MESI,
   DRAGON,
-  MOESI
+  MOESI,
+  HYBRID, // Dragon updates, but a copy updated too often without being accessed is invalidated instead
+  MESIF, // MESI with a single Forward sharer supplying clean shared blocks
+  MSI, // MESI without Exclusive, only a Modified owner supplies blocks
+  DIRECTORY // MESI with a directory per mesh node instead of a snooping bus
 };
 
-enum CACHELINE_STATE {
+enum CACHELINE_STATE : uint8_t {
   INVALID = 0, // MESI/DRAGON
   EXCLUSIVE = 1, // MESI
   SHARED = 2, // MESI
   MODIFIED = 3, // MESI/DRAGON
   SHARED_CLEAN = 4, // DRAGON
   SHARED_MODIFIED = 5, // DRAGON
-  OWNED = 6 // MOESI
+  OWNED = 6, // MOESI
+  FORWARD = 7 // MESIF
 };
 
 std::string toString(CACHELINE_STATE state);
+std::string toString(COHERENCE_PROTOCOL protocol);
 
-struct CacheLine {
-  uint32_t tag;
-  int lastUsed = -1;
-  CACHELINE_STATE state = INVALID;
+// L1 cache lines stored as structure of arrays, the line for a way is at index setIdx * associativity + blockIdx. The
+// shared L2 uses the same layout. Replacement state is kept by the cache's replacement policy
+struct L1Cache {
+  std::vector<uint64_t> tags;
+  std::vector<CACHELINE_STATE> states;
+
+  L1Cache(const int numLines) : tags(numLines, 0), states(numLines, INVALID) {}
+};
+
+// View of a single line spread across the arrays of an L1Cache
+struct CacheLineRef {
+  uint64_t& tag;
+  CACHELINE_STATE& state;
+  const uint32_t setIdx;
+  const int blockIdx;
 };
 
 struct MemoryRequest {
+  uint64_t address;
   int coreNum; 
+  int instIdx; // position in the core's trace, tells apart the requests of a non blocking core
+  uint32_t issueCycle = 0; // low bits of the cycle the core issued it, latencies are taken modulo 2^32
   Architecture::INSTRUCTION_TYPE type; // only read or write
-  uint32_t address;
+  bool isPrefetch; // issued by the core's prefetcher rather than the core, which does not wait for it
+  Architecture::REQUEST_SOURCE source = Architecture::L1_HIT; // set once it gets the bus
 
-  MemoryRequest(const int coreNum, const Architecture::INSTRUCTION_TYPE type, const uint32_t address) : coreNum(coreNum), type(type), address(address) {}
+  MemoryRequest(const int coreNum, const Architecture::INSTRUCTION_TYPE type, const uint64_t address, const int instIdx = 0, const bool isPrefetch = false) : address(address), coreNum(coreNum), instIdx(instIdx), type(type), isPrefetch(isPrefetch) {}
 };
+static_assert(sizeof(MemoryRequest) == 24);
 
 struct BusTransaction {
   MemoryRequest request;
@@ -52,109 +94,557 @@ struct BusTransaction {
   int blockIdx;
   bool processed = false;
   int remainingCycles = 0;
+  int memoryCycles = 0; // part of remaining cycles spent accessing memory, off the bus with a split bus
 
-  BusTransaction(const MemoryRequest& request, const uint32_t setIdx, const int blockIdx, const int remainingCycles = 0) 
-      : request(request), setIdx(setIdx), blockIdx(blockIdx), remainingCycles(remainingCycles) {}
+  // An evicted dirty line has to be written back to memory before the transaction
+  BusTransaction(const MemoryRequest& request, const uint32_t setIdx, const int blockIdx, const int writeBackCycles = 0) 
+      : request(request), setIdx(setIdx), blockIdx(blockIdx), remainingCycles(writeBackCycles), memoryCycles(writeBackCycles) {}
 };
 
+// FIFO ring buffer in place of std::queue, keeping its storage once grown so steady state pushes do not allocate.
+// Items can also be read in place from the front
+template <typename T>
+class RingQueue {
+public:
+  static constexpr size_t MIN_CAPACITY = 16; // power of two, capacity doubles from here
+
+  bool empty() const {return m_size == 0;}
+  size_t size() const {return m_size;}
+  T& front() {return m_items[m_head];}
+  const T& front() const {return m_items[m_head];}
+  const T& operator[](const size_t idx) const {return m_items[(m_head + idx) & (m_items.size() - 1)];}
+  template <typename Predicate>
+  bool anyOf(Predicate&& predicate) const {
+    for (size_t idx = 0; idx < m_size; ++idx) {
+      if (predicate((*this)[idx])) return true;
+    }
+    return false;
+  }
+
+  void push(const T& item) {
+    if (m_size == m_items.size()) grow(item);
+    m_items[(m_head + m_size) & (m_items.size() - 1)] = item;
+    ++m_size;
+  }
+  template <typename... Args>
+  void emplace(Args&&... args) {push(T(std::forward<Args>(args)...));}
+  void pop() {
+    m_head = (m_head + 1) & (m_items.size() - 1);
+    --m_size;
+  }
 
-class MemorySystem {
-public: // static
-  // call this before creating any objects to ensure the correct number of cache lines etc are constructed
-  static bool initialiseStaticCacheVariables(const int cacheSize, const int associativity, const int blockSize);
+private:
+  // Unused slots are filled with copies of filler, so T needs no default constructor
+  void grow(const T& filler) {
+    std::vector<T> items;
+    items.reserve(std::max(2 * m_items.size(), MIN_CAPACITY));
+    for (size_t idx = 0; idx < m_size; ++idx) {
+      items.push_back(std::move(m_items[(m_head + idx) & (m_items.size() - 1)]));
+    }
+    items.resize(items.capacity(), filler);
+    m_items = std::move(items);
+    m_head = 0;
+  }
 
-  static uint32_t getBlockOffset(const uint32_t address);
-  static uint32_t getSetIdx(const uint32_t address);
-  static uint32_t getTag(const uint32_t address);
+  std::vector<T> m_items; // size is the capacity, a power of two
+  size_t m_head = 0;
+  size_t m_size = 0;
+};
+
+// Requests completing a few ticks from now, bucketed by the tick they complete on so each tick only visits its own
+// completions. Buckets keep their storage, so steady state scheduling does not allocate
+class CompletionWheel {
+public:
+  static constexpr int NUM_SLOTS = 16; // power of two, the longest delay that can be scheduled
+  static_assert(L1_CACHE_HIT_CYCLES <= NUM_SLOTS);
+
+  explicit CompletionWheel(const int expectedPerTick);
+
+  // Completes on the given number of ticks from the next advance, 1 for the next advance itself
+  void schedule(const MemoryRequest& request, const int cycles);
+  // Moves the requests completing on this tick to completedMemoryRequests and steps to the next tick
+  void advance(std::vector<MemoryRequest>& completedMemoryRequests);
+  // Steps over ticks that complete no requests
+  void skip(const long long cycles) {m_currSlot = (m_currSlot + cycles) & (NUM_SLOTS - 1);}
+  // Number of upcoming ticks before one completes a request, 0 if the next does, max int if none are scheduled
+  int cyclesUntilNextCompletion() const;
+  bool empty() const {return m_numScheduled == 0;}
+
+private:
+  std::array<std::vector<MemoryRequest>, NUM_SLOTS> m_slots; // by completion tick modulo NUM_SLOTS
+  int m_currSlot = 0; // slot of the next advance
+  int m_numScheduled = 0;
+};
+
+// Cache sizing and the address decomposition it implies
+struct CacheGeometry {
+  int cacheSize = 0;
+  int associativity = 0;
+  int blockSize = 0;
+  int numBlocks = 0;
+  int numSets = 0;
+  int wordsPerBlock = 0;
+  int blockOffsetRShiftBits = 0;
+  uint64_t blockOffsetMask = 0;
+  int setIdxRShiftBits = 0;
+  uint64_t setIdxMask = 0;
+  int tagRShiftBits = 0;
+  uint64_t tagMask = 0;
+
+  // Returns false if the sizes do not describe a valid cache
+  bool initialise(const int cacheSize, const int associativity, const int blockSize);
+
+  uint32_t getBlockOffset(const uint64_t address) const {return (address & blockOffsetMask) >> blockOffsetRShiftBits;}
+  uint32_t getSetIdx(const uint64_t address) const {return (address & setIdxMask) >> setIdxRShiftBits;}
+  uint64_t getTag(const uint64_t address) const {return (address & tagMask) >> tagRShiftBits;}
+  uint64_t getBlockAddress(const uint64_t address) const {return address & ~blockOffsetMask;}
+  uint64_t getBlockAddress(const uint64_t tag, const uint32_t setIdx) const {return (tag << tagRShiftBits) | (uint64_t(setIdx) << setIdxRShiftBits);}
+};
+
+enum L2_POLICY : uint8_t {
+  L2_INCLUSIVE, // every block in an L1 is also in the L2, evicting it from the L2 invalidates the L1 copies
+  L2_NON_INCLUSIVE, // filled alongside the L1s but evicted independently of them
+  L2_EXCLUSIVE // victim cache of blocks evicted from the L1s, a hit moves the block back up to the L1
+};
+constexpr char L2_INCLUSIVE_STRING[] = "inclusive";
+constexpr char L2_NON_INCLUSIVE_STRING[] = "non-inclusive";
+constexpr char L2_EXCLUSIVE_STRING[] = "exclusive";
+std::string toString(L2_POLICY policy);
+
+// Shared L2 between the bus and memory, serving the L1 fills and write backs that would otherwise go to memory
+struct L2Config {
+  CacheGeometry geometry; // cache size 0 for no L2
+  int hitCycles = L2_CACHE_DEFAULT_HIT_CYCLES;
+  L2_POLICY policy = L2_INCLUSIVE;
+  bool useAsSnoopFilter = false; // inclusive only, presence bits in each L2 line replace the separate snoop filter
+
+  bool isEnabled() const {return geometry.cacheSize > 0;}
+  // Returns false if the L2 blocks can not hold whole L1 blocks, exclusive L2 blocks must match the L1 blocks
+  bool isCompatible(const CacheGeometry& l1Geometry) const;
+};
 
+// Optional memory system features, all off by default
+struct MemorySystemConfig {
+  bool useSnoopFilter = false;
+  // Split transaction bus, releasing the bus while up to this many transactions access memory. 0 holds the bus for
+  // the whole transaction
+  int maxOutstandingMemoryTransactions = 0;
+  // Non blocking L1s, each core can have this many bus transactions outstanding to different blocks. 0 for blocking L1s
+  int numMshrs = 0;
+  L2Config l2;
+  Prefetch::PrefetcherConfig prefetcher;
+  Replacement::REPLACEMENT_POLICY replacementPolicy = Replacement::LRU; // for the L1s and the L2
+  // Hybrid protocol: a shared copy receiving this many updates without its core accessing it is invalidated on the
+  // last of them. 1 invalidates like MESI, the maximum of 255 rarely invalidates
+  int hybridUpdateThreshold = HYBRID_DEFAULT_UPDATE_THRESHOLD;
+  Mesh::MeshConfig mesh; // directory protocol interconnect
+  Dram::DramConfig dram; // memory controller, disabled for a flat memory latency
+  int sharingProfileTopLines = 0; // 0 disables the sharing profiler, else the number of hottest blocks it reports
+  bool quiet = false; // skips the Initialised lines, for sweeps writing their table to stdout
+};
+
+// Miss status holding register, tracks a core's outstanding bus transaction for a block
+struct Mshr {
+  uint64_t blockAddress;
+  uint32_t setIdx;
+  int blockIdx; // way reserved for the block until the transaction completes
+  std::vector<MemoryRequest> mergedRequests; // later requests to the block, replayed once it completes
+};
+
+// A prefetch on the bus, demand requests to its block wait for it rather than fetching the block again
+struct InFlightPrefetch {
+  int coreNum;
+  uint64_t blockAddress;
+  std::vector<MemoryRequest> waitingRequests;
+  bool issued = false; // false until it fetches the block, it is skipped if the block arrived while it waited for the bus
+};
+
+// Presence bits per block address recording which L1s may hold the block, so snoops only visit possible sharers
+class SnoopFilter {
+public:
+  explicit SnoopFilter(const int numCores);
+
+  void addSharer(const uint64_t blockAddress, const int coreNum);
+  void removeSharer(const uint64_t blockAddress, const int coreNum);
+  // Appends the possible sharers other than excludedCoreNum in ascending core order
+  void getSharers(const uint64_t blockAddress, const int excludedCoreNum, std::vector<int>& sharers) const;
+
+private:
+  static constexpr uint64_t EMPTY_SLOT = UINT64_MAX; // block address of an unused slot, never a block start
+  static constexpr size_t INITIAL_SLOTS = 1 << 12;
+
+  // Open addressed with linear probing like Sharing::SharingProfiler, returns the block's slot or the empty slot that
+  // ends its probe
+  size_t findSlot(const uint64_t blockAddress) const;
+  // Empties the slot, shifting later entries of its probe back so lookups never need tombstones
+  void eraseSlot(size_t slotIdx);
+  // Doubles the table, rehashing every entry into it
+  void grow();
+
+  const int m_wordsPerEntry;
+  std::vector<uint64_t> m_blockAddresses; // power of two sized, at most half full
+  std::vector<uint64_t> m_presenceBits; // m_wordsPerEntry words per slot
+  int m_slotShift; // 64 - log2 of the number of slots, for the multiplicative hash
+  size_t m_numUsedSlots = 0;
+};
+
+class MemorySystem {
 protected: // static
   static constexpr int INVALID_BLOCK_IDX = -1; 
 
-  static COHERENCE_PROTOCOL protocol;
-  static int cacheSize;
-  static int associativity;
-  static int blockSize;
-  static int numBlocks;
-  static int numSets;
-  static int wordsPerBlock;
-  static int blockOffsetRShiftBits;
-  static uint32_t blockOffsetMask;
-  static int setIdxRShiftBits;
-  static uint32_t setIdxMask;
-  static int tagRShiftBits;
-  static uint32_t tagMask;
-
 public:
-  MemorySystem();
+  MemorySystem(const CacheGeometry& geometry, const int numCores, const MemorySystemConfig& config, Architecture::GlobalReport& report, const Architecture::GlobalCycleCounter& cycleCounter);
+  virtual ~MemorySystem() = default;
 
+  // Protocol is the exact type of this memory system, so its handlers are called directly and can be inlined, or
+  // MemorySystem to call them through the vtable. Instantiated for MESI, Dragon and MOESI, whose tick loop is the
+  // hottest path of the simulator
+  template <typename Protocol = MemorySystem>
   void tickMemorySystem(const std::vector<MemoryRequest>& incomingMemoryRequests, std::vector<MemoryRequest>& completedMemoryRequests);
 
+  // Number of upcoming ticks that will not complete or start processing any request, 0 if the next tick does
+  int cyclesUntilNextEvent() const;
+  // Fast forward all executing and processed requests by the given number of eventless cycles
+  void skipCycles(const long long cycles);
+
+  // Number of upcoming ticks before the bus processes or completes a transaction, 0 if the next tick does or a
+  // non bus request is executing, max int if the bus is idle. Until then no core's cache lines can change state
+  // except through its own local hits
+  int cyclesUntilBusEvent() const;
+  // True if the request hits a line that can service it without a bus transaction (valid for loads, exclusive/modified for stores)
+  bool isLocalHit(const MemoryRequest& request) const;
+  // False if a non blocking cache can not take the request yet, as it needs a bus transaction and the core has no free
+  // MSHR or every way of the set is reserved by outstanding misses. Always true for blocking caches
+  bool canAcceptRequest(const MemoryRequest& request) const;
+  // Services a local hit immediately, without queueing it as an executing request
+  void serviceLocalHit(const MemoryRequest& request);
+  // Bumped every time another core's bus transaction finds a line in this core's cache, the only way its lines can
+  // change state other than through its own requests
+  long long getNumSnoopHits(const int coreNum) const {return m_numSnoopHits[coreNum];}
+  // Fills in the report counters only tallied once the simulation ends
+  void finaliseReport() const {
+    if (m_sharingProfilerPtr) m_sharingProfilerPtr->fillReport(m_report);
+  }
+
 protected:
   // If exists in cache returns {setIdx, blockIdx} else blockIdx = -1 
-  std::pair<uint32_t, int> findInCache(int cacheNum, uint32_t address) const;
-  // Finds the block index of the block to replace by LRU
-  int findBlockIdxToReplace(const int coreNum, const uint32_t setIdx) const;
+  std::pair<uint32_t, int> findInCache(int cacheNum, uint64_t address) const;
+  // findInCache for another core's cache during a bus transaction, counting the hit as a possible change to the line
+  std::pair<uint32_t, int> snoopCache(int cacheNum, uint64_t address) {
+    auto found = findInCache(cacheNum, address);
+    m_numSnoopHits[cacheNum] += (found.second != INVALID_BLOCK_IDX);
+    return found;
+  }
+  // Finds the block index of the block to replace, the first invalid way else the replacement policy's victim,
+  // skipping ways reserved by outstanding misses. -1 if every way is reserved
+  int findBlockIdxToReplace(const int coreNum, const uint32_t setIdx);
+  CacheLineRef getCacheLine(const int coreNum, const uint32_t setIdx, const int blockIdx) {
+    const size_t lineIdx = size_t(setIdx) * m_geometry.associativity + blockIdx;
+    L1Cache& cache = m_l1Caches[coreNum];
+    return {cache.tags[lineIdx], cache.states[lineIdx], setIdx, blockIdx};
+  }
+  size_t getLineIdx(const CacheLineRef& cacheLine) const {return size_t(cacheLine.setIdx) * m_geometry.associativity + cacheLine.blockIdx;}
+  // Replacement policy updates for an access to the line, and for a new block placed in it
+  void touchLine(const int coreNum, const CacheLineRef& cacheLine) {m_replacementByCore[coreNum]->touch(cacheLine.setIdx, cacheLine.blockIdx);}
+  void insertLine(const int coreNum, const CacheLineRef& cacheLine) {
+    m_replacementByCore[coreNum]->insert(cacheLine.setIdx, cacheLine.blockIdx);
+    if (m_sharingProfilerPtr) m_sharingProfilerPtr->resetLine(coreNum, getLineIdx(cacheLine));
+  }
+  // Sharing profiler: the request's core accessed its line, and a store by another core invalidated or updated the
+  // other core's copy of the address
+  void profileAccess(const MemoryRequest& request, const CacheLineRef& cacheLine) {
+    if (m_sharingProfilerPtr) m_sharingProfilerPtr->recordAccess(request.coreNum, getLineIdx(cacheLine), request.address, request.type == Architecture::STORE);
+  }
+  void profileRemoteWrite(const uint64_t address, const int otherCoreNum, const CacheLineRef& otherCacheLine, const bool isUpdate) {
+    if (m_sharingProfilerPtr) m_sharingProfilerPtr->recordRemoteWrite(address, otherCoreNum, getLineIdx(otherCacheLine), isUpdate);
+  }
+  // Cores other than the initiating core that may hold the address, every other core without a snoop filter
+  const std::vector<int>& getSnoopTargets(const int initiatingCoreIdx, const uint64_t address);
+  // Keep the snoop filter in step with cache lines becoming valid or invalid
+  void addToSnoopFilter(const int coreNum, const uint64_t blockAddress) {
+    if (m_snoopFilterPtr) m_snoopFilterPtr->addSharer(blockAddress, coreNum);
+    else if (m_l2Config.useAsSnoopFilter) setL2Presence(coreNum, blockAddress, true);
+  }
+  void removeFromSnoopFilter(const int coreNum, const uint64_t blockAddress) {
+    if (m_snoopFilterPtr) m_snoopFilterPtr->removeSharer(blockAddress, coreNum);
+    else if (m_l2Config.useAsSnoopFilter) setL2Presence(coreNum, blockAddress, false);
+  }
+  // Cycles to evict a valid line from the core's L1, writing it back if dirty
+  int evictL1Line(const int coreNum, const uint64_t blockAddress, const bool isDirty);
+
+  // Shared L2, all return the cycles taken including any write back of an L2 victim to memory. accessCycle is the
+  // cycle the access reaches the L2
+  int findInL2(const uint64_t address, uint32_t& setIdx) const;
+  int loadThroughL2(const uint64_t address, const long long accessCycle);
+  int writeToL2(const uint64_t address, const bool isDirty, const long long accessCycle);
+  int insertIntoL2(const uint64_t address, const bool isDirty, const long long accessCycle);
+  int evictFromL2(const uint32_t setIdx, const int blockIdx, const long long accessCycle);
+  // Invalidates every L1 copy of the L2 block, returns true if any of them was dirty
+  bool backInvalidate(const size_t l2LineIdx, const uint64_t blockAddress);
+  void setL2Presence(const int coreNum, const uint64_t blockAddress, const bool isPresent);
+  // Cycles to read the block from memory or hand a write back to it, through the memory controller if enabled
+  int readFromMemory(const uint64_t blockAddress, const long long accessCycle);
+  int writeToMemory(const uint64_t blockAddress, const long long accessCycle);
+
+  // Queues a bus transaction, tracking it in an MSHR for non blocking caches
+  void enqueueBusTransaction(const MemoryRequest& request, const uint32_t setIdx, const int blockIdx, const int writeBackCycles = 0);
+  // Reports the request and, for non blocking caches, frees its MSHR and replays the requests merged into it
+  template <typename Protocol = MemorySystem>
+  void completeBusTransaction(const MemoryRequest& request, std::vector<MemoryRequest>& completedMemoryRequests);
+  // Non blocking caches: adds the request to the core's MSHR for its block if there is one
+  bool mergeIntoMshr(const MemoryRequest& request);
+  bool isWayReserved(const int coreNum, const uint32_t setIdx, const int blockIdx) const;
+  int countReservedWays(const int coreNum, const uint32_t setIdx) const;
+  // Passes a request from a core, or one replayed after the transaction it waited on, to the protocol unless it
+  // waits on an outstanding transaction to its block
+  template <typename Protocol = MemorySystem>
+  void acceptRequest(const MemoryRequest& request);
+
+  // Prefetches queue behind every demand request and only go on the bus when no demand request is waiting
+  void trainPrefetcher(const MemoryRequest& request);
+  void queuePrefetch(const int coreNum, const uint64_t address);
+  // Moves the oldest queued prefetch still worth fetching onto the bus, false if there is none
+  bool issueQueuedPrefetch();
+  // Demand requests to a block with a prefetch on the bus wait for it, a prefetch still queued is dropped
+  bool mergeIntoPrefetch(const MemoryRequest& request);
+  // Allocates the prefetched block's line before the protocol processes the prefetch as a load
+  template <typename Protocol = MemorySystem>
+  void processPrefetch(BusTransaction& transaction);
+  template <typename Protocol = MemorySystem>
+  void completePrefetch(const MemoryRequest& request);
+  // processBusTransaction for demand requests and prefetches alike, logging demand requests served by another cache
+  template <typename Protocol = MemorySystem>
+  void startBusTransaction(BusTransaction& transaction);
+
+  // Moves transactions through the interconnect for a tick, by default the atomic or split bus. The interconnect
+  // hooks are only called through the vtable if m_usesBus is false, the bus is called directly
+  virtual void tickInterconnect(std::vector<MemoryRequest>& completedMemoryRequests);
+  template <typename Protocol = MemorySystem>
+  void tickBus(std::vector<MemoryRequest>& completedMemoryRequests);
+  // Number of upcoming ticks before the interconnect processes or completes a transaction, 0 if the next tick does
+  virtual int cyclesUntilInterconnectEvent() const;
+  virtual void skipInterconnectCycles(const long long cycles);
+  // Transactions waiting for the interconnect, sampled every cycle for the report
+  virtual int countQueuedTransactions() const {return m_queuedBusTransactions.size();}
+
+  // Split bus: request phases run on the bus one at a time, memory phases overlap, and responses get the bus
+  // before new requests. A request to a block with a transaction still in flight waits for it to complete
+  template <typename Protocol = MemorySystem>
+  void tickSplitBus(std::vector<MemoryRequest>& completedMemoryRequests);
+  bool isBlockInFlight(const uint64_t address) const;
+  int cyclesUntilSplitBusEvent() const;
+  void skipSplitBusCycles(const long long cycles);
 
   // Resolves request if no need for bus transaction, else adds to the bus transaction queue
   virtual void handleIncomingRequest(const MemoryRequest& request) = 0;
+  // Updates the line and access counters for a hit that needs no bus transaction
+  virtual void updateOnLocalHit(const MemoryRequest& request, CacheLineRef cacheLine) = 0;
   virtual void processBusTransaction(BusTransaction& transaction) = 0;
+  // Call the protocol's handlers directly when Protocol is its exact type, else through the vtable
+  template <typename Protocol>
+  void handleIncomingRequestAs(const MemoryRequest& request) {
+    if constexpr (std::is_same_v<Protocol, MemorySystem>) handleIncomingRequest(request);
+    else static_cast<Protocol*>(this)->Protocol::handleIncomingRequest(request);
+  }
+  template <typename Protocol>
+  void processBusTransactionAs(BusTransaction& transaction) {
+    if constexpr (std::is_same_v<Protocol, MemorySystem>) processBusTransaction(transaction);
+    else static_cast<Protocol*>(this)->Protocol::processBusTransaction(transaction);
+  }
 
   // For Report
-  int getAndLog_L1_CACHE_LOAD_FROM_MEM_CYCLES() {
-    Architecture::GlobalReport::busDataTrafficBytes += blockSize;
-    return L1_CACHE_LOAD_FROM_MEM_CYCLES;
+  // delayCycles: cycles from now until the request reaches memory or the L2
+  int getAndLog_L1_CACHE_LOAD_FROM_MEM_CYCLES(const uint64_t address, const int delayCycles = 0) {
+    m_report.busDataTrafficBytes += m_geometry.blockSize;
+    m_report.l1MemoryTrafficBytes += m_geometry.blockSize;
+    const long long accessCycle = m_cycleCounter.getCounter() + delayCycles;
+    int cycles;
+    if (m_l2CachePtr) {
+      cycles = loadThroughL2(address, accessCycle);
+    } else {
+      m_report.memoryTrafficBytes += m_geometry.blockSize;
+      cycles = readFromMemory(m_geometry.getBlockAddress(address), accessCycle);
+    }
+    m_memoryCyclesLogged += cycles;
+    return cycles;
   }
 
-  int getAndLog_L1_CACHE_WRITE_BACK_CYCLES() {
-    Architecture::GlobalReport::busDataTrafficBytes += blockSize;
-    return L1_CACHE_WRITE_BACK_CYCLES;
+  int getAndLog_L1_CACHE_WRITE_BACK_CYCLES(const uint64_t blockAddress, const int delayCycles = 0) {
+    m_report.busDataTrafficBytes += m_geometry.blockSize;
+    m_report.l1MemoryTrafficBytes += m_geometry.blockSize;
+    const long long accessCycle = m_cycleCounter.getCounter() + delayCycles;
+    int cycles;
+    if (m_l2CachePtr) {
+      cycles = writeToL2(blockAddress, true, accessCycle);
+    } else {
+      m_report.memoryTrafficBytes += m_geometry.blockSize;
+      cycles = writeToMemory(blockAddress, accessCycle);
+    }
+    m_memoryCyclesLogged += cycles;
+    return cycles;
   }
 
   int getAndLog_L1_CACHE_LOAD_WORD_FROM_BUS_CYCLES() {
-    Architecture::GlobalReport::busDataTrafficBytes += Architecture::WORD_SIZE_BYTES;
+    m_report.busDataTrafficBytes += Architecture::WORD_SIZE_BYTES;
     return L1_CACHE_LOAD_FROM_BUS_PER_WORD_CYCLES;
   }
 
   int getAndLog_L1_CACHE_LOAD_BLOCK_FROM_BUS_CYCLES() {
-    Architecture::GlobalReport::busDataTrafficBytes += blockSize;
-    return L1_CACHE_LOAD_FROM_BUS_PER_WORD_CYCLES * wordsPerBlock;
+    m_report.busDataTrafficBytes += m_geometry.blockSize;
+    ++m_numBlocksFromCaches;
+    return L1_CACHE_LOAD_FROM_BUS_PER_WORD_CYCLES * m_geometry.wordsPerBlock;
   }
 
 protected:
-  std::array<std::vector<std::vector<CacheLine>>, Architecture::NUM_CORES> m_l1Caches;
-  std::queue<BusTransaction> m_queuedBusTransactions; // for requests that require a bus transaction, can only execute in serial
-  std::vector<std::pair<MemoryRequest, int>> m_executingNonBusRequests; // for requests that dont need a bus transaction(cache hit no bus transaction), can execute in parallel
+  const CacheGeometry m_geometry;
+  Architecture::GlobalReport& m_report;
+  const Architecture::GlobalCycleCounter& m_cycleCounter;
+  const int m_numCores;
+  std::vector<L1Cache> m_l1Caches;
+  std::vector<std::unique_ptr<Replacement::ReplacementPolicy>> m_replacementByCore;
+  std::vector<int> m_reservedWays; // scratch for findBlockIdxToReplace
+  std::unique_ptr<SnoopFilter> m_snoopFilterPtr; // only set if the snoop filter is enabled
+  std::vector<int> m_snoopTargets;
+  RingQueue<BusTransaction> m_queuedBusTransactions; // for requests that require a bus transaction, can only execute in serial
+  CompletionWheel m_executingNonBusRequests; // for requests that dont need a bus transaction(cache hit no bus transaction), can execute in parallel
+  std::vector<long long> m_numSnoopHits;
+  const int m_maxOutstandingMemoryTransactions; // 0 for an atomic bus
+  bool m_usesBus = true; // false if a subclass overrides the interconnect hooks to replace the bus
+  long long m_memoryCyclesLogged = 0; // running total, lets the split bus take a transaction's memory cycles off the bus
+  long long m_numBlocksFromCaches = 0; // running total, tells which transactions were served by another cache
+  std::vector<BusTransaction> m_outstandingMemoryTransactions; // split bus: in their memory phase, remaining cycles count the access
+  RingQueue<BusTransaction> m_queuedBusResponses; // split bus: memory phase done, waiting for the bus to return their block
+  bool m_isBusResponding = false; // split bus: the front response holds the bus
+  const int m_numMshrs; // 0 for blocking caches
+  std::vector<std::vector<Mshr>> m_mshrsByCore;
+  std::vector<std::vector<MemoryRequest>> m_freeMergedRequestLists; // emptied merged request lists, kept for their storage
+  const L2Config m_l2Config;
+  std::unique_ptr<L1Cache> m_l2CachePtr; // only set if the L2 is enabled, lines use INVALID, SHARED for clean and MODIFIED for dirty
+  std::unique_ptr<Replacement::ReplacementPolicy> m_l2ReplacementPtr;
+  const int m_l2PresenceWordsPerLine; // L2 snoop filter: presence bits of the cores holding part of each L2 line
+  std::vector<uint64_t> m_l2PresenceBits;
+  std::unique_ptr<Dram::DramController> m_dramPtr; // only set if the memory controller is enabled
+  std::unique_ptr<Sharing::SharingProfiler> m_sharingProfilerPtr; // only set if sharing profiling is enabled
+  std::vector<std::unique_ptr<Prefetch::Prefetcher>> m_prefetchersByCore; // empty without prefetching
+  std::vector<uint64_t> m_prefetchAddresses;
+  std::deque<MemoryRequest> m_queuedPrefetches;
+  std::vector<InFlightPrefetch> m_inFlightPrefetches;
+  std::vector<std::unordered_set<uint64_t>> m_prefetchedBlocksByCore; // prefetched blocks not yet accessed by the core
 };
 
 class MesiMemorySystem : public MemorySystem {
+  friend class MemorySystem; // for its statically dispatched tick
+
 public:
-  MesiMemorySystem() = default;
+  using MemorySystem::MemorySystem;
 
 protected:
   void handleIncomingRequest(const MemoryRequest& request) override;
+  void updateOnLocalHit(const MemoryRequest& request, CacheLineRef cacheLine) override;
   void processBusTransaction(BusTransaction& transaction) override;
 
 };
 
 class DragonMemorySystem : public MemorySystem {
+  friend class MemorySystem; // for its statically dispatched tick
+
 public:
-  DragonMemorySystem() = default;
+  using MemorySystem::MemorySystem;
 
 protected:
   void handleIncomingRequest(const MemoryRequest& request) override;
+  void updateOnLocalHit(const MemoryRequest& request, CacheLineRef cacheLine) override;
   void processBusTransaction(BusTransaction& transaction) override;
 
 };
 
 class MOESIMemorySystem : public MemorySystem {
+  friend class MemorySystem; // for its statically dispatched tick
+
 public:
-  MOESIMemorySystem() = default;
+  using MemorySystem::MemorySystem;
 
 protected:
   void handleIncomingRequest(const MemoryRequest& request) override;
+  void updateOnLocalHit(const MemoryRequest& request, CacheLineRef cacheLine) override;
+  void processBusTransaction(BusTransaction& transaction) override;
+
+};
+
+// Competitive update: Dragon, except each copy counts the updates it received since its core last accessed it. The
+// update that reaches the threshold invalidates the copy instead, so producer consumer blocks keep being updated
+// while migratory blocks and blocks no longer read fall back to invalidation
+class HybridMemorySystem : public DragonMemorySystem {
+public:
+  HybridMemorySystem(const CacheGeometry& geometry, const int numCores, const MemorySystemConfig& config, Architecture::GlobalReport& report, const Architecture::GlobalCycleCounter& cycleCounter);
+
+protected:
+  void updateOnLocalHit(const MemoryRequest& request, CacheLineRef cacheLine) override;
+  void processBusTransaction(BusTransaction& transaction) override;
+
+private:
+  static constexpr uint8_t UPDATE_MODE = 1;
+  static constexpr uint8_t INVALIDATE_MODE = 2;
+
+  uint8_t& getUpdatesSinceAccess(const int coreNum, const CacheLineRef& cacheLine) {
+    return m_updatesSinceAccessByCore[coreNum][getLineIdx(cacheLine)];
+  }
+  // Counts the block as running in the mode, or as switched once it has run in both
+  void logBlockMode(const uint64_t blockAddress, const uint8_t mode);
+
+  const int m_updateThreshold;
+  std::vector<std::vector<uint8_t>> m_updatesSinceAccessByCore; // per line, like the L1Cache arrays
+  std::unordered_map<uint64_t, uint8_t> m_blockModes; // modes each written shared block has run in
+};
+
+
+// MESI where the most recent requester of a shared block holds it in Forward. Only a Modified, Exclusive or Forward
+// copy supplies the block, so a read of a block held only in Shared goes to memory
+class MesifMemorySystem : public MesiMemorySystem {
+public:
+  using MesiMemorySystem::MesiMemorySystem;
+
+protected:
+  void updateOnLocalHit(const MemoryRequest& request, CacheLineRef cacheLine) override;
   void processBusTransaction(BusTransaction& transaction) override;
+};
 
+// MESI without the Exclusive state, every load miss fills Shared and the first store to it needs the bus. Only a
+// Modified owner supplies the block, clean blocks always come from memory
+class MsiMemorySystem : public MesiMemorySystem {
+public:
+  using MesiMemorySystem::MesiMemorySystem;
+
+protected:
+  void processBusTransaction(BusTransaction& transaction) override;
 };
 
+// MESI kept coherent by a directory at each block's home node, chosen by interleaving block addresses over the nodes
+// of a 2D mesh, instead of by snooping a bus. The sharers the directory holds are kept in the snoop filter. Each home
+// starts at most one transaction a tick, unless its block has one in flight, and transactions to different blocks
+// overlap. Their latency is that of the messages they send over the mesh. Only a Modified or Exclusive owner supplies
+// a block, blocks held in Shared come from memory at the home node
+class DirectoryMemorySystem : public MesiMemorySystem {
+public:
+  DirectoryMemorySystem(const CacheGeometry& geometry, const int numCores, const MemorySystemConfig& config, Architecture::GlobalReport& report, const Architecture::GlobalCycleCounter& cycleCounter);
+
+protected:
+  void processBusTransaction(BusTransaction& transaction) override;
+  void tickInterconnect(std::vector<MemoryRequest>& completedMemoryRequests) override;
+  int cyclesUntilInterconnectEvent() const override;
+  void skipInterconnectCycles(const long long cycles) override;
+  int countQueuedTransactions() const override {return m_queuedBusTransactions.size() + m_numHomeQueued;}
+
+private:
+  int getHomeNode(const uint64_t address) const {return (address / m_geometry.blockSize) % m_mesh.getNumNodes();}
+  bool isBlockBusy(const uint64_t address) const;
+  // Moves newly queued transactions to the queues of their home nodes
+  void distributeTransactions();
+
+  Mesh::MeshNetwork m_mesh;
+  std::vector<RingQueue<BusTransaction>> m_homeQueues; // per node, waiting for the home's directory
+  int m_numHomeQueued = 0; // summed over the home queues
+  std::vector<BusTransaction> m_inFlightTransactions; // processed, waiting for their messages to arrive
+};
 
 }
\ No newline at end of file
@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "architecture.h"
+#include "cache.h"
+#include "processor.h"
+
+// Times the simulation of a trace with the protocol handlers called through the vtable against the statically
+// dispatched tick, for each protocol with a specialised tick. Reports the fastest of the repetitions
+int main(int argc, char *argv[]) {
+  if (argc < 5) {
+    std::fprintf(stderr, "Invalid Usage, please input ./dispatch-benchmark <input_file> <cache_size> <associativity> <block_size> [data_folder] [--repetitions=num_runs] [--engine=cycle|event]\n");
+    return 1;
+  }
+
+  // Parse arguments
+  Processor::CPUConfig config;
+  if (!config.geometry.initialise(std::atoi(argv[2]), std::atoi(argv[3]), std::atoi(argv[4]))) {
+    std::fprintf(stderr, "Error: Invalid cache geometry %s %s %s\n", argv[2], argv[3], argv[4]);
+    return 1;
+  }
+  std::filesystem::path dataFolder = "data";
+  int numRepetitions = 5;
+  for (int argIdx = 5; argIdx < argc; ++argIdx) {
+    if (std::strncmp(argv[argIdx], "--", 2)) {
+      dataFolder = argv[argIdx];
+    } else if (!std::strncmp(argv[argIdx], "--repetitions=", 14)) {
+      numRepetitions = std::atoi(argv[argIdx] + 14);
+      if (numRepetitions <= 0) {
+        std::fprintf(stderr, "Error: Failed to parse %s into number of repetitions\n", argv[argIdx] + 14);
+        return 1;
+      }
+    } else if (!std::strcmp(argv[argIdx], "--engine=cycle")) {
+      config.engineMode = Processor::CYCLE;
+    } else if (!std::strcmp(argv[argIdx], "--engine=event")) {
+      config.engineMode = Processor::EVENT;
+    } else {
+      std::fprintf(stderr, "Error: Unknown option %s\n", argv[argIdx]);
+      return 1;
+    }
+  }
+
+  const std::string inputFileName = argv[1];
+  const int numCores = Architecture::countTraceFiles(dataFolder, inputFileName);
+  auto instructionsByCorePtr = std::make_shared<std::vector<std::vector<Architecture::Instruction>>>();
+  if (numCores == 0 || !Architecture::loadInstructionsFromFiles(dataFolder, inputFileName, numCores, *instructionsByCorePtr)) {
+    std::fprintf(stderr, "Error: Failed to load input file(s) %s from %s\n", argv[1], dataFolder.c_str());
+    return 1;
+  }
+
+  struct Result {
+    Cache::COHERENCE_PROTOCOL protocol;
+    double virtualSeconds;
+    double staticSeconds;
+  };
+  std::vector<Result> results;
+  for (Cache::COHERENCE_PROTOCOL protocol : {Cache::MESI, Cache::DRAGON, Cache::MOESI}) {
+    config.protocol = protocol;
+    double bestSeconds[2] = {1e30, 1e30}; // virtual, static
+    long long overallExecutionCycles[2] = {0, 0};
+    for (int repetition = 0; repetition < numRepetitions; ++repetition) {
+      for (int isStatic = 0; isStatic < 2; ++isStatic) { // alternate so both see the same machine state
+        config.useStaticDispatch = isStatic;
+        Processor::CPU cpu(instructionsByCorePtr, config);
+        const auto startTime = std::chrono::steady_clock::now();
+        cpu.simulate();
+        bestSeconds[isStatic] = std::min(bestSeconds[isStatic], std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count());
+        overallExecutionCycles[isStatic] = cpu.getReport().overallExecutionCycles;
+      }
+    }
+    if (overallExecutionCycles[0] != overallExecutionCycles[1]) {
+      std::fprintf(stderr, "Error: %s took %lld cycles through the vtable but %lld statically dispatched\n", Cache::toString(protocol).c_str(), overallExecutionCycles[0], overallExecutionCycles[1]);
+      return 1;
+    }
+    results.push_back({protocol, bestSeconds[0], bestSeconds[1]});
+  }
+
+  std::cout << "\nProtocol\tVirtual (s)\tStatic (s)\tSpeedup\n";
+  for (const Result& result : results) {
+    std::cout << Cache::toString(result.protocol) << '\t' << result.virtualSeconds << '\t' << result.staticSeconds << '\t' << result.virtualSeconds / result.staticSeconds << "x\n";
+  }
+}
@@ -0,0 +1,114 @@
+#include "dram.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace Dram {
+
+DramController::DramController(const DramConfig& config, Architecture::GlobalReport& report) : m_config(config), m_report(report),
+    m_banks(size_t(config.numChannels) * config.numBanks), m_channelReservedCycles(size_t(config.numChannels) * CHANNEL_SCHEDULE_CYCLES, -1) {
+  m_report.dramChannels = config.numChannels;
+  m_report.dramBanks = config.numBanks;
+  m_writeBuffer.reserve(config.writeBufferEntries);
+}
+
+long long DramController::read(const uint64_t address, const long long arrivalCycle) {
+  ++m_report.numDramReads;
+  if (std::any_of(m_writeBuffer.begin(), m_writeBuffer.end(), [&](const BufferedWrite& write) {return write.address == address;})) {
+    ++m_report.numDramWriteBufferForwards; // newest copy is still waiting in the write buffer
+    m_report.dramReadLatencyCycles += m_config.burstCycles;
+    return arrivalCycle + m_config.burstCycles;
+  }
+
+  // Writes get the banks only while they would otherwise sit idle before this read
+  for (int writeIdx = pickWrite(arrivalCycle); writeIdx >= 0; writeIdx = pickWrite(arrivalCycle)) {
+    drainWrite(writeIdx);
+  }
+  const long long cycle = access(address, arrivalCycle);
+  m_report.dramReadLatencyCycles += cycle - arrivalCycle;
+  return cycle;
+}
+
+long long DramController::write(const uint64_t address, const long long arrivalCycle) {
+  for (int writeIdx = pickWrite(arrivalCycle); writeIdx >= 0; writeIdx = pickWrite(arrivalCycle)) {
+    drainWrite(writeIdx);
+  }
+  auto writeIt = std::find_if(m_writeBuffer.begin(), m_writeBuffer.end(), [&](const BufferedWrite& write) {return write.address == address;});
+  if (writeIt != m_writeBuffer.end()) { // merges with the buffered write to the same block
+    return arrivalCycle;
+  }
+
+  long long acceptCycle = arrivalCycle;
+  if (m_writeBuffer.size() == m_config.writeBufferEntries) { // waits for a write to leave the full buffer
+    ++m_report.numDramWriteBufferFullStalls;
+    acceptCycle = std::max(acceptCycle, drainWrite(pickWrite(std::numeric_limits<long long>::max())));
+  }
+  m_writeBuffer.push_back({address, acceptCycle});
+  return acceptCycle;
+}
+
+long long DramController::access(const uint64_t address, const long long arrivalCycle) {
+  Bank& bank = m_banks[getBankIdx(address)];
+  const long long row = getRow(address);
+  const long long startCycle = std::max(arrivalCycle, bank.freeCycle);
+  int accessCycles = m_config.rowHitCycles;
+  if (bank.openRow == row) {
+    ++m_report.numDramRowHits;
+  } else if (bank.openRow == NO_OPEN_ROW) {
+    ++m_report.numDramRowMisses;
+    accessCycles = m_config.rowMissCycles;
+  } else {
+    ++m_report.numDramRowConflicts;
+    accessCycles = m_config.rowConflictCycles;
+  }
+  bank.openRow = row; // left open for later accesses
+
+  const long long dataCycle = reserveChannel(getChannel(address), startCycle + accessCycles);
+  // Once the row is open, column accesses to it pipeline a burst apart
+  bank.freeCycle = startCycle + accessCycles - m_config.rowHitCycles + m_config.burstCycles;
+  return dataCycle + m_config.burstCycles;
+}
+
+long long DramController::reserveChannel(const int channel, const long long readyCycle) {
+  long long* reservedCycles = &m_channelReservedCycles[size_t(channel) * CHANNEL_SCHEDULE_CYCLES];
+  long long dataCycle = readyCycle;
+  for (int i = 0; i < m_config.burstCycles;) { // first run of burstCycles free cycles
+    if (reservedCycles[(dataCycle + i) % CHANNEL_SCHEDULE_CYCLES] != dataCycle + i) {
+      ++i;
+    } else {
+      dataCycle += i + 1;
+      i = 0;
+    }
+  }
+  for (int i = 0; i < m_config.burstCycles; ++i) {
+    reservedCycles[(dataCycle + i) % CHANNEL_SCHEDULE_CYCLES] = dataCycle + i;
+  }
+  return dataCycle;
+}
+
+int DramController::pickWrite(const long long beforeCycle) const {
+  int pickedIdx = -1;
+  bool isPickedRowHit = false;
+  for (int writeIdx = 0; writeIdx < m_writeBuffer.size(); ++writeIdx) {
+    const BufferedWrite& write = m_writeBuffer[writeIdx];
+    const Bank& bank = m_banks[getBankIdx(write.address)];
+    if (std::max(write.arrivalCycle, bank.freeCycle) >= beforeCycle) continue;
+    const bool isRowHit = bank.openRow == getRow(write.address);
+    if (pickedIdx < 0 || (isRowHit && !isPickedRowHit)) {
+      pickedIdx = writeIdx;
+      isPickedRowHit = isRowHit;
+    }
+  }
+  return pickedIdx;
+}
+
+long long DramController::drainWrite(const int writeIdx) {
+  const BufferedWrite write = m_writeBuffer[writeIdx];
+  m_writeBuffer.erase(m_writeBuffer.begin() + writeIdx);
+  ++m_report.numDramWrites;
+  const long long startCycle = std::max(write.arrivalCycle, m_banks[getBankIdx(write.address)].freeCycle);
+  access(write.address, write.arrivalCycle);
+  return startCycle;
+}
+
+} // namespace
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "architecture.h"
+
+namespace Dram {
+constexpr int DEFAULT_NUM_BANKS = 8; // per channel
+constexpr int DEFAULT_ROW_BYTES = 2048;
+constexpr int DEFAULT_ROW_HIT_CYCLES = 30; // column access to the open row
+constexpr int DEFAULT_ROW_MISS_CYCLES = 60; // activate and column access on a bank with no open row
+constexpr int DEFAULT_ROW_CONFLICT_CYCLES = 90; // precharge, activate and column access on a bank with another row open
+constexpr int DEFAULT_BURST_CYCLES = 4; // channel data bus cycles to move a block
+constexpr int DEFAULT_WRITE_BUFFER_ENTRIES = 32;
+constexpr long long NO_OPEN_ROW = -1;
+constexpr int CHANNEL_SCHEDULE_CYCLES = 4096; // how far ahead of one another data bus reservations can be told apart
+
+struct DramConfig {
+  int numChannels = 0; // 0 for a flat memory latency without a controller
+  int numBanks = DEFAULT_NUM_BANKS;
+  int rowBytes = DEFAULT_ROW_BYTES;
+  int rowHitCycles = DEFAULT_ROW_HIT_CYCLES;
+  int rowMissCycles = DEFAULT_ROW_MISS_CYCLES;
+  int rowConflictCycles = DEFAULT_ROW_CONFLICT_CYCLES;
+  int burstCycles = DEFAULT_BURST_CYCLES;
+  int writeBufferEntries = DEFAULT_WRITE_BUFFER_ENTRIES;
+
+  bool isEnabled() const {return numChannels > 0;}
+};
+
+// Memory controller in front of banked DRAM with open row buffers. Addresses map to row, then bank, then channel,
+// then column, so consecutive blocks share a row. Reads are scheduled as they arrive and take priority over writes.
+// Write backs wait in a write buffer, drained first ready first come first served (row hits before older writes)
+// whenever their bank is idle before the next read, or when the buffer is full
+class DramController {
+public:
+  DramController(const DramConfig& config, Architecture::GlobalReport& report);
+
+  // Cycle the block read from memory at arrivalCycle has crossed the channel
+  long long read(const uint64_t address, const long long arrivalCycle);
+  // Buffers a write back arriving at arrivalCycle, returns the cycle the write buffer accepts it
+  long long write(const uint64_t address, const long long arrivalCycle);
+
+private:
+  struct Bank {
+    long long openRow = NO_OPEN_ROW;
+    long long freeCycle = 0; // first cycle the bank can start another access
+  };
+
+  struct BufferedWrite {
+    uint64_t address;
+    long long arrivalCycle;
+  };
+
+  long long getRow(const uint64_t address) const {return address / m_config.rowBytes / m_config.numChannels / m_config.numBanks;}
+  int getChannel(const uint64_t address) const {return address / m_config.rowBytes % m_config.numChannels;}
+  size_t getBankIdx(const uint64_t address) const {
+    // Hashed row bits are folded into the bank, so arrays aligned to large powers of two spread over the banks
+    const uint64_t bank = (address / m_config.rowBytes / m_config.numChannels) ^ ((uint32_t(getRow(address)) * 2654435761u) >> 16);
+    return size_t(getChannel(address)) * m_config.numBanks + bank % m_config.numBanks;
+  }
+  // Accesses the address's bank at or after arrivalCycle, returns the cycle its data has crossed the channel
+  long long access(const uint64_t address, const long long arrivalCycle);
+  // Reserves the channel's data bus for a burst from the first free cycles at or after readyCycle, returns the first
+  long long reserveChannel(const int channel, const long long readyCycle);
+  // Next write for the scheduler, row hits first then oldest, only considering writes that can start before
+  // beforeCycle. Returns its write buffer index, -1 if there is none
+  int pickWrite(const long long beforeCycle) const;
+  // Writes the buffered write to its bank, returns the cycle it starts
+  long long drainWrite(const int writeIdx);
+
+  const DramConfig m_config;
+  Architecture::GlobalReport& m_report;
+  std::vector<Bank> m_banks; // indexed channel * banks + bank
+  // Cycle each channel's data bus is reserved for, by channel then cycle % CHANNEL_SCHEDULE_CYCLES. Kept per cycle
+  // so data returning from a busy bank does not hold up data from the others
+  std::vector<long long> m_channelReservedCycles;
+  std::vector<BufferedWrite> m_writeBuffer; // oldest first
+};
+} // namespace
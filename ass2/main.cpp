@@ -1,18 +1,28 @@
 #include "cache.h"
-#include <array>
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <exception>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "architecture.h"
 #include "cache.h"
 #include "processor.h"
+#include "sharing_profiler.h"
+#include "stack_distance.h"
+#include "sweep.h"
 
 namespace {
-  inline bool parseStringToInt(char str[], int& i) {
+  constexpr int DEFAULT_INSTRUCTION_WINDOW = 16;
+
+  inline bool parseStringToInt(const char str[], int& i) {
     try {
       i = std::stoi(str);
     } catch (const std::exception& e) {
@@ -20,72 +30,423 @@ namespace {
     }
     return true;
   }
+
+  // Parses a comma separated list of ints, a single value is a list of one
+  inline bool parseStringToIntList(const char str[], std::vector<int>& values) {
+    std::stringstream stream(str);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+      int value;
+      if (!parseStringToInt(item.c_str(), value)) {
+        return false;
+      }
+      values.push_back(value);
+    }
+    return !values.empty();
+  }
+
+  // Parses a comma separated list of protocols
+  inline bool parseStringToProtocolList(const char str[], std::vector<Cache::COHERENCE_PROTOCOL>& protocols) {
+    std::stringstream stream(str);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+      // TODO case insensitive parsing
+      if (item == Cache::MESI_STRING) {
+        protocols.push_back(Cache::MESI);
+      } else if (item == Cache::DRAGON_STRING) {
+        protocols.push_back(Cache::DRAGON);
+      } else if (item == Cache::MOESI_STRING) {
+        protocols.push_back(Cache::MOESI);
+      } else if (item == Cache::HYBRID_STRING) {
+        protocols.push_back(Cache::HYBRID);
+      } else if (item == Cache::MESIF_STRING) {
+        protocols.push_back(Cache::MESIF);
+      } else if (item == Cache::MSI_STRING) {
+        protocols.push_back(Cache::MSI);
+      } else if (item == Cache::DIRECTORY_STRING) {
+        protocols.push_back(Cache::DIRECTORY);
+      } else {
+        return false;
+      }
+    }
+    return !protocols.empty();
+  }
 }
 
 
 int main(int argc, char *argv[]) {
   if (argc < 6) {
-    std::fprintf(stderr, "Invalid Usage, please input ./coherence <protocol> <input_file> <cache_size> <associativity> <block_size> [data_folder]\n");
+    std::fprintf(stderr, "Invalid Usage, please input ./coherence <protocol> <input_file> <cache_size> <associativity> <block_size> [data_folder] [--engine=cycle|event|quantum] [--virtual-dispatch] [--cache-trace] [--stream[=ring_size]] [--cores=num_cores] [--snoop-filter] [--split-bus=outstanding_memory_transactions] [--mshrs=num_mshrs] [--window=num_instructions] [--store-buffer=depth] [--l2=size,associativity,block_size[,hit_cycles]] [--l2-policy=inclusive|non-inclusive|exclusive] [--l2-snoop-filter] [--prefetch=next-line|stride|stream] [--prefetch-degree=num_blocks] [--replacement=lru|plru|srrip|brrip|random] [--hybrid-threshold=num_updates] [--mesh=width,height] [--mesh-hop-cycles=cycles] [--mesh-link-bytes=bytes_per_cycle] [--dram=channels,banks] [--dram-timing=hit_cycles,miss_cycles,conflict_cycles] [--dram-row-bytes=bytes] [--dram-write-buffer=entries] [--sharing-profile[=num_lines]] [--threads=num_threads] [--sweep-output=file] [--stack-distance]\n"
+                         "Protocol, cache size, associativity and block size may be comma separated lists to sweep every combination\n"
+                         "--stack-distance reports LRU hit rates for every cache size, associativity and block size combination in one pass without timing\n");
     return 1;
   }
 
   // Parse protocol
-  // TODO case insensitive parsing
-  Cache::COHERENCE_PROTOCOL protocol;
-  if (!std::strcmp(argv[1], Cache::MESI_STRING)) {
-    protocol = Cache::MESI;
-  } else if (!std::strcmp(argv[1], Cache::DRAGON_STRING)) {
-    protocol = Cache::DRAGON;
-  } else if (!std::strcmp(argv[1], Cache::MOESI_STRING)) {
-    protocol = Cache::MOESI;
-  } else {
-    std::fprintf(stderr, "Error: Only %s or %s protocols allowed\n", Cache::MESI_STRING, Cache::DRAGON_STRING);
+  std::vector<Cache::COHERENCE_PROTOCOL> protocols;
+  if (!parseStringToProtocolList(argv[1], protocols)) {
+    std::fprintf(stderr, "Error: Only %s, %s, %s, %s, %s, %s or %s protocols allowed\n", Cache::MESI_STRING, Cache::DRAGON_STRING, Cache::MOESI_STRING, Cache::HYBRID_STRING, Cache::MESIF_STRING, Cache::MSI_STRING, Cache::DIRECTORY_STRING);
     return 1;
   }
 
   // Parse cache size
-  int cacheSize;
-  if (!parseStringToInt(argv[3], cacheSize)) {
+  std::vector<int> cacheSizes;
+  if (!parseStringToIntList(argv[3], cacheSizes)) {
     std::fprintf(stderr, "Error: Failed to parse %s into cache size\n", argv[3]);
     return 1;
   }
 
   // Associativity
-  int associativity;
-  if (!parseStringToInt(argv[4], associativity)) {
+  std::vector<int> associativities;
+  if (!parseStringToIntList(argv[4], associativities)) {
     std::fprintf(stderr, "Error: Failed to parse %s into associativty\n", argv[4]);
     return 1;
   }
 
   // Block Size
-  int blockSize;
-  if (!parseStringToInt(argv[5], blockSize)) {
+  std::vector<int> blockSizes;
+  if (!parseStringToIntList(argv[5], blockSizes)) {
     std::fprintf(stderr, "Error: Failed to parse %s into block size\n", argv[5]);
     return 1;
   }
 
-  Cache::MemorySystem::initialiseStaticCacheVariables(cacheSize, associativity, blockSize); // initialise static cache sizing variables, needed in l1 cache constructor
+  // Get data folder and options if applicable
+  std::filesystem::path dataFolder = std::filesystem::current_path() / Architecture::DEFAULT_DATA_FOLDER;
+  Processor::ENGINE_MODE engineMode = Processor::CYCLE;
+  bool cacheTrace = false; // write binary sidecars next to the text traces for faster reloading
+  bool streamTrace = false; // parse traces in the background while simulating instead of loading them up front
+  int streamCapacity = Architecture::InstructionStream::DEFAULT_CAPACITY;
+  int numCores = 0; // inferred from the number of trace files if not given
+  Cache::MemorySystemConfig memoryConfig;
+  int numThreads = std::thread::hardware_concurrency(); // for sweeps
+  std::filesystem::path sweepOutputPath; // sweep table goes to stdout if not given
+  int instructionWindow = 0; // non blocking cores if MSHRs are given
+  int storeBufferDepth = 0;
+  std::vector<int> l2Params; // size, associativity, block size and optionally hit cycles
+  bool stackDistance = false; // only compute hit rates for the swept geometries, no coherence or timing
+  bool useStaticDispatch = true;
+  bool hasMeshOption = false; // only the directory protocol runs over a mesh
+  for (int argIdx = 6; argIdx < argc; ++argIdx) {
+    if (std::strncmp(argv[argIdx], "--", 2)) { // not an option, must be the data folder
+      dataFolder = argv[argIdx];
+    } else if (!std::strcmp(argv[argIdx], "--engine=cycle")) {
+      engineMode = Processor::CYCLE;
+    } else if (!std::strcmp(argv[argIdx], "--engine=event")) {
+      engineMode = Processor::EVENT;
+    } else if (!std::strcmp(argv[argIdx], "--engine=quantum")) {
+      engineMode = Processor::QUANTUM;
+    } else if (!std::strcmp(argv[argIdx], "--virtual-dispatch")) {
+      useStaticDispatch = false;
+    } else if (!std::strcmp(argv[argIdx], "--cache-trace")) {
+      cacheTrace = true;
+    } else if (!std::strcmp(argv[argIdx], "--stream")) {
+      streamTrace = true;
+    } else if (!std::strncmp(argv[argIdx], "--stream=", 9)) {
+      streamTrace = true;
+      if (!parseStringToInt(argv[argIdx] + 9, streamCapacity) || streamCapacity <= 0) {
+        std::fprintf(stderr, "Error: Failed to parse %s into stream ring size\n", argv[argIdx] + 9);
+        return 1;
+      }
+    } else if (!std::strcmp(argv[argIdx], "--snoop-filter")) {
+      memoryConfig.useSnoopFilter = true;
+    } else if (!std::strncmp(argv[argIdx], "--split-bus=", 12)) {
+      if (!parseStringToInt(argv[argIdx] + 12, memoryConfig.maxOutstandingMemoryTransactions) || memoryConfig.maxOutstandingMemoryTransactions <= 0) {
+        std::fprintf(stderr, "Error: Failed to parse %s into number of outstanding memory transactions\n", argv[argIdx] + 12);
+        return 1;
+      }
+    } else if (!std::strncmp(argv[argIdx], "--cores=", 8)) {
+      if (!parseStringToInt(argv[argIdx] + 8, numCores) || numCores <= 0) {
+        std::fprintf(stderr, "Error: Failed to parse %s into number of cores\n", argv[argIdx] + 8);
+        return 1;
+      }
+    } else if (!std::strncmp(argv[argIdx], "--mshrs=", 8)) {
+      if (!parseStringToInt(argv[argIdx] + 8, memoryConfig.numMshrs) || memoryConfig.numMshrs <= 0) {
+        std::fprintf(stderr, "Error: Failed to parse %s into number of MSHRs\n", argv[argIdx] + 8);
+        return 1;
+      }
+    } else if (!std::strncmp(argv[argIdx], "--window=", 9)) {
+      if (!parseStringToInt(argv[argIdx] + 9, instructionWindow) || instructionWindow <= 0) {
+        std::fprintf(stderr, "Error: Failed to parse %s into instruction window size\n", argv[argIdx] + 9);
+        return 1;
+      }
+    } else if (!std::strncmp(argv[argIdx], "--store-buffer=", 15)) {
+      if (!parseStringToInt(argv[argIdx] + 15, storeBufferDepth) || storeBufferDepth <= 0) {
+        std::fprintf(stderr, "Error: Failed to parse %s into store buffer depth\n", argv[argIdx] + 15);
+        return 1;
+      }
+    } else if (!std::strncmp(argv[argIdx], "--l2=", 5)) {
+      l2Params.clear();
+      if (!parseStringToIntList(argv[argIdx] + 5, l2Params) || l2Params.size() < 3 || l2Params.size() > 4) {
+        std::fprintf(stderr, "Error: Failed to parse %s into L2 size, associativity, block size and hit cycles\n", argv[argIdx] + 5);
+        return 1;
+      }
+    } else if (!std::strncmp(argv[argIdx], "--l2-policy=", 12)) {
+      const char* policy = argv[argIdx] + 12;
+      if (!std::strcmp(policy, Cache::L2_INCLUSIVE_STRING)) {
+        memoryConfig.l2.policy = Cache::L2_INCLUSIVE;
+      } else if (!std::strcmp(policy, Cache::L2_NON_INCLUSIVE_STRING)) {
+        memoryConfig.l2.policy = Cache::L2_NON_INCLUSIVE;
+      } else if (!std::strcmp(policy, Cache::L2_EXCLUSIVE_STRING)) {
+        memoryConfig.l2.policy = Cache::L2_EXCLUSIVE;
+      } else {
+        std::fprintf(stderr, "Error: Only %s, %s or %s L2 policies allowed\n", Cache::L2_INCLUSIVE_STRING, Cache::L2_NON_INCLUSIVE_STRING, Cache::L2_EXCLUSIVE_STRING);
+        return 1;
+      }
+    } else if (!std::strcmp(argv[argIdx], "--l2-snoop-filter")) {
+      memoryConfig.l2.useAsSnoopFilter = true;
+    } else if (!std::strncmp(argv[argIdx], "--prefetch=", 11)) {
+      const char* prefetcher = argv[argIdx] + 11;
+      if (!std::strcmp(prefetcher, Prefetch::NEXT_LINE_STRING)) {
+        memoryConfig.prefetcher.type = Prefetch::NEXT_LINE;
+      } else if (!std::strcmp(prefetcher, Prefetch::STRIDE_STRING)) {
+        memoryConfig.prefetcher.type = Prefetch::STRIDE;
+      } else if (!std::strcmp(prefetcher, Prefetch::STREAM_STRING)) {
+        memoryConfig.prefetcher.type = Prefetch::STREAM;
+      } else {
+        std::fprintf(stderr, "Error: Only %s, %s or %s prefetchers allowed\n", Prefetch::NEXT_LINE_STRING, Prefetch::STRIDE_STRING, Prefetch::STREAM_STRING);
+        return 1;
+      }
+    } else if (!std::strncmp(argv[argIdx], "--prefetch-degree=", 18)) {
+      if (!parseStringToInt(argv[argIdx] + 18, memoryConfig.prefetcher.degree) || memoryConfig.prefetcher.degree <= 0) {
+        std::fprintf(stderr, "Error: Failed to parse %s into prefetch degree\n", argv[argIdx] + 18);
+        return 1;
+      }
+    } else if (!std::strncmp(argv[argIdx], "--replacement=", 14)) {
+      const char* policy = argv[argIdx] + 14;
+      if (!std::strcmp(policy, Replacement::LRU_STRING)) {
+        memoryConfig.replacementPolicy = Replacement::LRU;
+      } else if (!std::strcmp(policy, Replacement::TREE_PLRU_STRING)) {
+        memoryConfig.replacementPolicy = Replacement::TREE_PLRU;
+      } else if (!std::strcmp(policy, Replacement::SRRIP_STRING)) {
+        memoryConfig.replacementPolicy = Replacement::SRRIP;
+      } else if (!std::strcmp(policy, Replacement::BRRIP_STRING)) {
+        memoryConfig.replacementPolicy = Replacement::BRRIP;
+      } else if (!std::strcmp(policy, Replacement::RANDOM_STRING)) {
+        memoryConfig.replacementPolicy = Replacement::RANDOM;
+      } else {
+        std::fprintf(stderr, "Error: Only %s, %s, %s, %s or %s replacement allowed\n", Replacement::LRU_STRING, Replacement::TREE_PLRU_STRING, Replacement::SRRIP_STRING, Replacement::BRRIP_STRING, Replacement::RANDOM_STRING);
+        return 1;
+      }
+    } else if (!std::strncmp(argv[argIdx], "--hybrid-threshold=", 19)) {
+      if (!parseStringToInt(argv[argIdx] + 19, memoryConfig.hybridUpdateThreshold) || memoryConfig.hybridUpdateThreshold <= 0 || memoryConfig.hybridUpdateThreshold > UINT8_MAX) {
+        std::fprintf(stderr, "Error: Failed to parse %s into a hybrid update threshold from 1 to %d\n", argv[argIdx] + 19, UINT8_MAX);
+        return 1;
+      }
+    } else if (!std::strncmp(argv[argIdx], "--mesh=", 7)) {
+      std::vector<int> meshDimensions;
+      if (!parseStringToIntList(argv[argIdx] + 7, meshDimensions) || meshDimensions.size() != 2 || meshDimensions[0] <= 0 || meshDimensions[1] <= 0) {
+        std::fprintf(stderr, "Error: Failed to parse %s into mesh width and height\n", argv[argIdx] + 7);
+        return 1;
+      }
+      memoryConfig.mesh.width = meshDimensions[0];
+      memoryConfig.mesh.height = meshDimensions[1];
+      hasMeshOption = true;
+    } else if (!std::strncmp(argv[argIdx], "--mesh-hop-cycles=", 18)) {
+      if (!parseStringToInt(argv[argIdx] + 18, memoryConfig.mesh.hopCycles) || memoryConfig.mesh.hopCycles <= 0) {
+        std::fprintf(stderr, "Error: Failed to parse %s into mesh cycles per hop\n", argv[argIdx] + 18);
+        return 1;
+      }
+      hasMeshOption = true;
+    } else if (!std::strncmp(argv[argIdx], "--mesh-link-bytes=", 18)) {
+      if (!parseStringToInt(argv[argIdx] + 18, memoryConfig.mesh.linkBytesPerCycle) || memoryConfig.mesh.linkBytesPerCycle <= 0) {
+        std::fprintf(stderr, "Error: Failed to parse %s into mesh link bytes per cycle\n", argv[argIdx] + 18);
+        return 1;
+      }
+      hasMeshOption = true;
+    } else if (!std::strncmp(argv[argIdx], "--dram=", 7)) {
+      std::vector<int> dramShape;
+      if (!parseStringToIntList(argv[argIdx] + 7, dramShape) || dramShape.size() != 2 || dramShape[0] <= 0 || dramShape[1] <= 0) {
+        std::fprintf(stderr, "Error: Failed to parse %s into DRAM channels and banks per channel\n", argv[argIdx] + 7);
+        return 1;
+      }
+      memoryConfig.dram.numChannels = dramShape[0];
+      memoryConfig.dram.numBanks = dramShape[1];
+    } else if (!std::strncmp(argv[argIdx], "--dram-timing=", 14)) {
+      std::vector<int> timing;
+      if (!parseStringToIntList(argv[argIdx] + 14, timing) || timing.size() != 3 || timing[0] <= 0 || timing[0] > timing[1] || timing[1] > timing[2]) {
+        std::fprintf(stderr, "Error: Failed to parse %s into increasing DRAM row hit, miss and conflict cycles\n", argv[argIdx] + 14);
+        return 1;
+      }
+      memoryConfig.dram.rowHitCycles = timing[0];
+      memoryConfig.dram.rowMissCycles = timing[1];
+      memoryConfig.dram.rowConflictCycles = timing[2];
+    } else if (!std::strncmp(argv[argIdx], "--dram-row-bytes=", 17)) {
+      if (!parseStringToInt(argv[argIdx] + 17, memoryConfig.dram.rowBytes) || memoryConfig.dram.rowBytes <= 0) {
+        std::fprintf(stderr, "Error: Failed to parse %s into DRAM row bytes\n", argv[argIdx] + 17);
+        return 1;
+      }
+    } else if (!std::strncmp(argv[argIdx], "--dram-write-buffer=", 20)) {
+      if (!parseStringToInt(argv[argIdx] + 20, memoryConfig.dram.writeBufferEntries) || memoryConfig.dram.writeBufferEntries <= 0) {
+        std::fprintf(stderr, "Error: Failed to parse %s into DRAM write buffer entries\n", argv[argIdx] + 20);
+        return 1;
+      }
+    } else if (!std::strcmp(argv[argIdx], "--sharing-profile")) {
+      memoryConfig.sharingProfileTopLines = Sharing::DEFAULT_TOP_LINES;
+    } else if (!std::strncmp(argv[argIdx], "--sharing-profile=", 18)) {
+      if (!parseStringToInt(argv[argIdx] + 18, memoryConfig.sharingProfileTopLines) || memoryConfig.sharingProfileTopLines <= 0) {
+        std::fprintf(stderr, "Error: Failed to parse %s into number of lines to profile\n", argv[argIdx] + 18);
+        return 1;
+      }
+    } else if (!std::strncmp(argv[argIdx], "--threads=", 10)) {
+      if (!parseStringToInt(argv[argIdx] + 10, numThreads) || numThreads <= 0) {
+        std::fprintf(stderr, "Error: Failed to parse %s into number of threads\n", argv[argIdx] + 10);
+        return 1;
+      }
+    } else if (!std::strncmp(argv[argIdx], "--sweep-output=", 15)) {
+      sweepOutputPath = argv[argIdx] + 15;
+    } else if (!std::strcmp(argv[argIdx], "--stack-distance")) {
+      stackDistance = true;
+    } else {
+      std::fprintf(stderr, "Error: Unknown option %s\n", argv[argIdx]);
+      return 1;
+    }
+  }
 
-  // Get data folder if applicable
-  std::filesystem::path dataFolder;
-  if (argc >= 7) {
-    dataFolder = argv[6];
-  } else {
-    dataFolder = std::filesystem::current_path() / Architecture::DEFAULT_DATA_FOLDER;
+  if (memoryConfig.numMshrs > 0 && instructionWindow == 0) {
+    instructionWindow = DEFAULT_INSTRUCTION_WINDOW;
+  } else if (memoryConfig.numMshrs == 0 && instructionWindow > 0) {
+    std::fprintf(stderr, "Error: --window needs --mshrs for non blocking caches\n");
+    return 1;
+  }
+  if (!l2Params.empty()) {
+    if (!memoryConfig.l2.geometry.initialise(l2Params[0], l2Params[1], l2Params[2]) || !Replacement::isSupported(memoryConfig.replacementPolicy, l2Params[1])) {
+      return 1;
+    }
+    if (l2Params.size() == 4) {
+      memoryConfig.l2.hitCycles = l2Params[3];
+    }
+    if (memoryConfig.l2.hitCycles <= 0) {
+      std::fprintf(stderr, "Error: L2 hit cycles must be positive\n");
+      return 1;
+    }
+  }
+  if (memoryConfig.l2.useAsSnoopFilter && (memoryConfig.l2.policy != Cache::L2_INCLUSIVE || !memoryConfig.l2.isEnabled() || memoryConfig.useSnoopFilter)) {
+    std::fprintf(stderr, "Error: --l2-snoop-filter needs an inclusive --l2 and replaces --snoop-filter\n");
+    return 1;
+  }
+  const bool hasDirectory = std::find(protocols.begin(), protocols.end(), Cache::DIRECTORY) != protocols.end();
+  if (hasDirectory && memoryConfig.maxOutstandingMemoryTransactions > 0) {
+    std::fprintf(stderr, "Error: %s replaces the bus with a mesh so can not be combined with --split-bus\n", Cache::DIRECTORY_STRING);
+    return 1;
+  }
+  if (!hasDirectory && hasMeshOption) {
+    std::fprintf(stderr, "Error: --mesh, --mesh-hop-cycles and --mesh-link-bytes need the %s protocol\n", Cache::DIRECTORY_STRING);
+    return 1;
+  }
+  if (storeBufferDepth > 0 && memoryConfig.numMshrs > 0) {
+    std::fprintf(stderr, "Error: --store-buffer is for blocking cores and can not be combined with --mshrs\n");
+    return 1;
+  }
+
+  // Build every combination of the swept parameters
+  std::vector<Processor::CPUConfig> configs;
+  for (Cache::COHERENCE_PROTOCOL protocol : protocols) {
+    for (int cacheSize : cacheSizes) {
+      for (int associativity : associativities) {
+        for (int blockSize : blockSizes) {
+          Processor::CPUConfig& config = configs.emplace_back();
+          config.protocol = protocol;
+          config.engineMode = engineMode;
+          config.memoryConfig = memoryConfig;
+          config.instructionWindow = instructionWindow;
+          config.storeBufferDepth = storeBufferDepth;
+          config.useStaticDispatch = useStaticDispatch;
+          if (!config.geometry.initialise(cacheSize, associativity, blockSize) || !memoryConfig.l2.isCompatible(config.geometry) || !Replacement::isSupported(memoryConfig.replacementPolicy, associativity)) {
+            return 1;
+          }
+        }
+      }
+    }
+  }
+  const bool isSweep = configs.size() > 1;
+  if ((isSweep || stackDistance) && streamTrace) {
+    std::fprintf(stderr, "Error: Streaming can not be used when sweeping multiple configurations or with --stack-distance\n");
+    return 1;
   }
 
   // Parse input file
   std::string inputFileName = argv[2];
-  std::array<std::vector<Architecture::Instruction>, Architecture::NUM_CORES> instructionsByCore;
-  if (!Architecture::loadInstructionsFromFiles(dataFolder, inputFileName, instructionsByCore)) {
-    std::fprintf(stderr, "Error: Failed to parse input file(s) %s\n", argv[2]);
+  if (numCores == 0) {
+    numCores = Architecture::countTraceFiles(dataFolder, inputFileName);
+    if (numCores == 0) {
+      std::fprintf(stderr, "Error: No input files %s_0 found in %s\n", argv[2], dataFolder.c_str());
+      return 1;
+    }
+  }
+  if (memoryConfig.mesh.width * memoryConfig.mesh.height > 0 && memoryConfig.mesh.width * memoryConfig.mesh.height < numCores) {
+    std::fprintf(stderr, "Error: A %dx%d mesh has fewer nodes than the %d cores\n", memoryConfig.mesh.width, memoryConfig.mesh.height, numCores);
+    return 1;
+  }
+  if (memoryConfig.sharingProfileTopLines > 0 && numCores > Sharing::MAX_PROFILED_CORES) {
+    std::fprintf(stderr, "Error: --sharing-profile supports at most %d cores\n", Sharing::MAX_PROFILED_CORES);
     return 1;
   }
+  std::unique_ptr<Processor::CPU> cpuPtr;
+  std::shared_ptr<std::vector<std::vector<Architecture::Instruction>>> instructionsByCorePtr; // not set when streaming
+  if (streamTrace) {
+    std::vector<std::unique_ptr<Architecture::InstructionStream>> streamsByCore;
+    if (!Architecture::openInstructionStreams(dataFolder, inputFileName, numCores, streamsByCore, streamCapacity)) {
+      std::fprintf(stderr, "Error: Failed to open input file(s) %s\n", argv[2]);
+      return 1;
+    }
+    cpuPtr = std::make_unique<Processor::CPU>(std::move(streamsByCore), configs.front());
+  } else {
+    instructionsByCorePtr = std::make_shared<std::vector<std::vector<Architecture::Instruction>>>();
+    if (!Architecture::loadInstructionsFromFiles(dataFolder, inputFileName, numCores, *instructionsByCorePtr, cacheTrace)) {
+      std::fprintf(stderr, "Error: Failed to parse input file(s) %s\n", argv[2]);
+      return 1;
+    }
 
-  Processor::CPU cpu(std::move(instructionsByCore), protocol);
+    if (stackDistance) {
+      // Protocol does not affect the analysis, keep one geometry per combination of the remaining parameters
+      std::vector<Cache::CacheGeometry> geometries;
+      for (int configIdx = 0; configIdx < configs.size() / protocols.size(); ++configIdx) {
+        geometries.push_back(configs[configIdx].geometry);
+      }
+      std::cout << "Computing stack distances for " << geometries.size() << " cache geometries" << std::endl;
+      if (sweepOutputPath.empty()) {
+        return StackDistance::runStackDistance(*instructionsByCorePtr, geometries, std::cout) ? 0 : 1;
+      }
+      std::ofstream sweepOutput(sweepOutputPath);
+      if (!sweepOutput.is_open()) {
+        std::fprintf(stderr, "Error: Failed to open %s for writing\n", sweepOutputPath.c_str());
+        return 1;
+      }
+      return StackDistance::runStackDistance(*instructionsByCorePtr, geometries, sweepOutput) ? 0 : 1;
+    }
+    if (isSweep) {
+      std::cout << "Sweeping " << configs.size() << " configurations on " << numThreads << " thread(s)" << std::endl;
+      if (sweepOutputPath.empty()) {
+        return Sweep::runSweep(instructionsByCorePtr, configs, numThreads, std::cout) ? 0 : 1;
+      }
+      std::ofstream sweepOutput(sweepOutputPath);
+      if (!sweepOutput.is_open()) {
+        std::fprintf(stderr, "Error: Failed to open %s for writing\n", sweepOutputPath.c_str());
+        return 1;
+      }
+      return Sweep::runSweep(instructionsByCorePtr, configs, numThreads, sweepOutput) ? 0 : 1;
+    }
+    cpuPtr = std::make_unique<Processor::CPU>(instructionsByCorePtr, configs.front());
+  }
 
   std::cout << "Simulating" << std::endl;
-  cpu.simulate();
+  cpuPtr->simulate();
+  if (cpuPtr->hasStreamFailed()) {
+    std::fprintf(stderr, "Error: Failed to parse input file(s) %s while streaming\n", argv[2]);
+    return 1;
+  }
 
-  std::cout << Architecture::printGlobalReport << std::endl;
+  Architecture::GlobalReport report = cpuPtr->getReport();
+  if (configs.front().protocol == Cache::HYBRID && instructionsByCorePtr) {
+    // Rerun the trace under the pure protocols the hybrid switches between to report the traffic it saves
+    std::cout << "Simulating " << Cache::MESI_STRING << " and " << Cache::DRAGON_STRING << " for comparison" << std::endl;
+    for (Cache::COHERENCE_PROTOCOL protocol : {Cache::MESI, Cache::DRAGON}) {
+      Processor::CPUConfig referenceConfig = configs.front();
+      referenceConfig.protocol = protocol;
+      Processor::CPU referenceCpu(instructionsByCorePtr, referenceConfig);
+      referenceCpu.simulate();
+      (protocol == Cache::MESI ? report.mesiBusDataTrafficBytes : report.dragonBusDataTrafficBytes) = referenceCpu.getReport().busDataTrafficBytes;
+    }
+  }
+  Architecture::printGlobalReport(std::cout, report) << std::endl;
 }
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Mesh {
+
+void chooseDimensions(const int numNodes, int& width, int& height) {
+  height = std::max(1, int(std::sqrt(double(numNodes))));
+  width = (numNodes + height - 1) / height;
+}
+
+MeshNetwork::MeshNetwork(const MeshConfig& config, Architecture::GlobalReport& report) : m_width(config.width), m_height(config.height),
+    m_hopCycles(config.hopCycles), m_linkBytesPerCycle(config.linkBytesPerCycle), m_report(report),
+    m_linkReservedCycles(size_t(config.width) * config.height * NUM_PORTS * LINK_SCHEDULE_CYCLES, -1) {
+  m_report.meshWidth = m_width;
+  m_report.meshHeight = m_height;
+  m_report.meshLinkBusyCycles.assign(size_t(m_width) * m_height * NUM_PORTS, 0);
+}
+
+long long MeshNetwork::send(const int srcNode, const int dstNode, const int bytes, const long long sendCycle) {
+  if (srcNode == dstNode) {
+    return sendCycle; // stays within the node
+  }
+  const int flitCycles = (bytes + m_linkBytesPerCycle - 1) / m_linkBytesPerCycle;
+  int x = srcNode % m_width;
+  int y = srcNode / m_width;
+  const int dstX = dstNode % m_width;
+  const int dstY = dstNode / m_width;
+  long long cycle = sendCycle;
+  ++m_report.numMeshMessages;
+  m_report.meshMessageHops += std::abs(dstX - x) + std::abs(dstY - y);
+  for (; x != dstX; x += (dstX > x) ? 1 : -1) {
+    cycle = reserveLink(y * m_width + x, (dstX > x) ? EAST : WEST, cycle, flitCycles);
+  }
+  for (; y != dstY; y += (dstY > y) ? 1 : -1) {
+    cycle = reserveLink(y * m_width + x, (dstY > y) ? SOUTH : NORTH, cycle, flitCycles);
+  }
+  return cycle + flitCycles - 1; // the tail follows the head by the message's length
+}
+
+bool MeshNetwork::isLinkFree(const size_t linkIdx, const long long cycle) const {
+  return m_linkReservedCycles[linkIdx * LINK_SCHEDULE_CYCLES + cycle % LINK_SCHEDULE_CYCLES] != cycle;
+}
+
+long long MeshNetwork::reserveLink(const int node, const PORT port, const long long cycle, const int flitCycles) {
+  const size_t linkIdx = size_t(node) * NUM_PORTS + port;
+  long long startCycle = cycle;
+  for (int i = 0; i < flitCycles;) { // first run of flitCycles free cycles
+    if (isLinkFree(linkIdx, startCycle + i)) {
+      ++i;
+    } else {
+      startCycle += i + 1;
+      i = 0;
+    }
+  }
+  for (int i = 0; i < flitCycles; ++i) {
+    m_linkReservedCycles[linkIdx * LINK_SCHEDULE_CYCLES + (startCycle + i) % LINK_SCHEDULE_CYCLES] = startCycle + i;
+  }
+  m_report.meshLinkBusyCycles[linkIdx] += flitCycles;
+  return startCycle + m_hopCycles; // head reaches the next router
+}
+
+} // namespace
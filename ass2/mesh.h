@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "architecture.h"
+
+namespace Mesh {
+constexpr int DEFAULT_HOP_CYCLES = 1; // router and link traversal for the head of a message
+constexpr int DEFAULT_LINK_BYTES_PER_CYCLE = 16;
+constexpr int CONTROL_MESSAGE_BYTES = 8; // requests, forwards, invalidations and acknowledgements, data messages add the block
+constexpr int NUM_PORTS = 4;
+constexpr int LINK_SCHEDULE_CYCLES = 1024; // how far ahead of one another link reservations can be told apart
+enum PORT : uint8_t {
+  EAST, // x + 1
+  WEST, // x - 1
+  NORTH, // y - 1
+  SOUTH // y + 1
+};
+
+struct MeshConfig {
+  int width = 0; // 0 for the squarest mesh with a node per core
+  int height = 0;
+  int hopCycles = DEFAULT_HOP_CYCLES;
+  int linkBytesPerCycle = DEFAULT_LINK_BYTES_PER_CYCLE;
+};
+
+// Squarest width and height, at least as wide as tall, with a node for each of numNodes
+void chooseDimensions(const int numNodes, int& width, int& height);
+
+// 2D mesh of nodes numbered row by row, routing X then Y. Each node has an output link per port, link index
+// node * NUM_PORTS + port. A message reserves each link on its route for as many cycles as its bytes take to cross
+// it, taking the first free cycles from when its head arrives. Reservations are kept per cycle, so messages sent for
+// later cycles, like memory replies, do not hold up earlier traffic
+class MeshNetwork {
+public:
+  MeshNetwork(const MeshConfig& config, Architecture::GlobalReport& report);
+
+  // Cycle the last byte of a message sent from srcNode at sendCycle arrives at dstNode
+  long long send(const int srcNode, const int dstNode, const int bytes, const long long sendCycle);
+  int getNumNodes() const {return m_width * m_height;}
+
+private:
+  long long reserveLink(const int node, const PORT port, const long long cycle, const int flitCycles);
+  bool isLinkFree(const size_t linkIdx, const long long cycle) const;
+
+  const int m_width;
+  const int m_height;
+  const int m_hopCycles;
+  const int m_linkBytesPerCycle;
+  Architecture::GlobalReport& m_report;
+  // Cycle each link is reserved for, by link then cycle % LINK_SCHEDULE_CYCLES
+  std::vector<long long> m_linkReservedCycles;
+};
+} // namespace
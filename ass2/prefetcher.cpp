@@ -0,0 +1,86 @@
+#include "prefetcher.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace Prefetch {
+
+std::string toString(PREFETCHER_TYPE type) {
+  switch (type) {
+    case NONE:
+      return "None";
+    case NEXT_LINE:
+      return NEXT_LINE_STRING;
+    case STRIDE:
+      return STRIDE_STRING;
+    case STREAM:
+      return STREAM_STRING;
+  }
+  return "Unknown Prefetcher";
+}
+
+std::unique_ptr<Prefetcher> makePrefetcher(const PrefetcherConfig& config, const int blockSize) {
+  switch (config.type) {
+    case NEXT_LINE:
+      return std::make_unique<NextLinePrefetcher>(config.degree, blockSize);
+    case STRIDE:
+      return std::make_unique<StridePrefetcher>(config.degree, blockSize);
+    case STREAM:
+      return std::make_unique<StreamPrefetcher>(config.degree, blockSize);
+    case NONE:
+      break;
+  }
+  return nullptr;
+}
+
+void NextLinePrefetcher::onAccess(const uint64_t address, const bool isTrigger, std::vector<uint64_t>& prefetchAddresses) {
+  if (!isTrigger) {
+    return;
+  }
+  const uint64_t blockAddress = address - address % m_blockSize;
+  for (int i = 1; i <= m_degree; ++i) {
+    prefetchAddresses.push_back(blockAddress + i * m_blockSize);
+  }
+}
+
+void StridePrefetcher::onAccess(const uint64_t address, const bool isTrigger, std::vector<uint64_t>& prefetchAddresses) {
+  const int64_t stride = int64_t(address) - int64_t(m_lastAddress);
+  m_isStrideConfirmed = stride != 0 && stride == m_stride;
+  m_stride = stride;
+  m_lastAddress = address;
+  if (!m_isStrideConfirmed || !isTrigger) { // trains on every access, prefetches only on triggers like the others
+    return;
+  }
+
+  // Strides within a block step a block at a time in the same direction
+  const int64_t step = (std::abs(stride) < m_blockSize) ? ((stride > 0) ? m_blockSize : -m_blockSize) : stride;
+  const int64_t blockAddress = address - address % m_blockSize;
+  for (int i = 1; i <= m_degree; ++i) {
+    prefetchAddresses.push_back(uint64_t(blockAddress + i * step));
+  }
+}
+
+void StreamPrefetcher::onAccess(const uint64_t address, const bool isTrigger, std::vector<uint64_t>& prefetchAddresses) {
+  if (!isTrigger) {
+    return;
+  }
+  const uint64_t block = address / m_blockSize;
+  ++m_numTriggers;
+
+  // Follow the stream already covering the block, else start a new one in the least recently used buffer
+  StreamBuffer* buffer = std::find_if(std::begin(m_buffers), std::end(m_buffers), [&](const StreamBuffer& candidate) {
+    return candidate.lastUsed >= 0 && block >= candidate.nextBlock && block <= candidate.lastPrefetchedBlock;
+  });
+  if (buffer == std::end(m_buffers)) {
+    buffer = std::min_element(std::begin(m_buffers), std::end(m_buffers), [](const StreamBuffer& a, const StreamBuffer& b) {return a.lastUsed < b.lastUsed;});
+    buffer->lastPrefetchedBlock = block;
+  }
+  buffer->nextBlock = block + 1;
+  buffer->lastUsed = m_numTriggers;
+  // Keep degree blocks ahead of the core
+  while (buffer->lastPrefetchedBlock < block + m_degree) {
+    ++buffer->lastPrefetchedBlock;
+    prefetchAddresses.push_back(buffer->lastPrefetchedBlock * uint64_t(m_blockSize));
+  }
+}
+} // namespace
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Prefetch {
+constexpr int DEFAULT_PREFETCH_DEGREE = 2;
+constexpr int NUM_STREAM_BUFFERS = 4;
+constexpr char NEXT_LINE_STRING[] = "next-line";
+constexpr char STRIDE_STRING[] = "stride";
+constexpr char STREAM_STRING[] = "stream";
+
+enum PREFETCHER_TYPE : uint8_t {
+  NONE,
+  NEXT_LINE, // the blocks following a missed block
+  STRIDE, // continues a repeated stride between consecutive accesses, no PCs in the traces so one stride per core
+  STREAM // stream buffers following ascending runs of missed blocks
+};
+
+std::string toString(PREFETCHER_TYPE type);
+
+struct PrefetcherConfig {
+  PREFETCHER_TYPE type = NONE;
+  int degree = DEFAULT_PREFETCH_DEGREE; // blocks prefetched ahead of each trigger
+};
+
+// Per core prefetcher watching the core's demand accesses
+class Prefetcher {
+public:
+  virtual ~Prefetcher() = default;
+
+  // Called for every demand access, isTrigger if it missed or was the first access to a prefetched block.
+  // Appends the addresses of blocks worth prefetching
+  virtual void onAccess(const uint64_t address, const bool isTrigger, std::vector<uint64_t>& prefetchAddresses) = 0;
+};
+
+// nullptr for NONE
+std::unique_ptr<Prefetcher> makePrefetcher(const PrefetcherConfig& config, const int blockSize);
+
+class NextLinePrefetcher : public Prefetcher {
+public:
+  NextLinePrefetcher(const int degree, const int blockSize) : m_degree(degree), m_blockSize(blockSize) {}
+  void onAccess(const uint64_t address, const bool isTrigger, std::vector<uint64_t>& prefetchAddresses) override;
+
+private:
+  const int m_degree;
+  const int m_blockSize;
+};
+
+class StridePrefetcher : public Prefetcher {
+public:
+  StridePrefetcher(const int degree, const int blockSize) : m_degree(degree), m_blockSize(blockSize) {}
+  void onAccess(const uint64_t address, const bool isTrigger, std::vector<uint64_t>& prefetchAddresses) override;
+
+private:
+  const int m_degree;
+  const int m_blockSize;
+  uint64_t m_lastAddress = 0;
+  int64_t m_stride = 0;
+  bool m_isStrideConfirmed = false; // the last two accesses were both m_stride apart
+};
+
+class StreamPrefetcher : public Prefetcher {
+public:
+  StreamPrefetcher(const int degree, const int blockSize) : m_degree(degree), m_blockSize(blockSize) {}
+  void onAccess(const uint64_t address, const bool isTrigger, std::vector<uint64_t>& prefetchAddresses) override;
+
+private:
+  // Blocks are numbered by address / block size
+  struct StreamBuffer {
+    uint64_t nextBlock = 0; // next block the stream expects the core to need
+    uint64_t lastPrefetchedBlock = 0;
+    long long lastUsed = -1; // -1 for a free buffer
+  };
+
+  const int m_degree;
+  const int m_blockSize;
+  StreamBuffer m_buffers[NUM_STREAM_BUFFERS];
+  long long m_numTriggers = 0; // LRU stamps
+};
+} // namespace
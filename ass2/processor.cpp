@@ -2,85 +2,500 @@
 #include "architecture.h"
 #include "cache.h"
 
+#include <algorithm>
+#include <limits>
 
 namespace Processor {
 
-CPU::CPU(std::array<std::vector<Architecture::Instruction>, Architecture::NUM_CORES>&& instructionsByCore, Cache::COHERENCE_PROTOCOL protocol) {
-  for (int i = 0; i < Architecture::NUM_CORES; ++i) {
-    m_cores[i].instructions.swap(instructionsByCore[i]);
+CPU::CPU(const int numCores, const CPUConfig& config) : m_engineMode(config.engineMode), m_instructionWindow(config.instructionWindow), m_storeBufferDepth(config.storeBufferDepth), m_cores(numCores) {
+  const Cache::COHERENCE_PROTOCOL protocol = config.protocol;
+  Cache::MemorySystemConfig memoryConfig = config.memoryConfig;
+  if (m_storeBufferDepth > 0) {
+    memoryConfig.numMshrs = STORE_BUFFER_MSHRS; // lets a load miss while a store drains
   }
   if (protocol == Cache::MESI) {
-    m_memorySystemPtr = std::make_unique<Cache::MesiMemorySystem>();
+    m_memorySystemPtr = std::make_unique<Cache::MesiMemorySystem>(config.geometry, numCores, memoryConfig, m_report, m_cycleCounter);
   } else if (protocol == Cache::DRAGON) {
-    m_memorySystemPtr = std::make_unique<Cache::DragonMemorySystem>();
+    m_memorySystemPtr = std::make_unique<Cache::DragonMemorySystem>(config.geometry, numCores, memoryConfig, m_report, m_cycleCounter);
   } else if (protocol == Cache::MOESI) {
-    m_memorySystemPtr = std::make_unique<Cache::MOESIMemorySystem>();
+    m_memorySystemPtr = std::make_unique<Cache::MOESIMemorySystem>(config.geometry, numCores, memoryConfig, m_report, m_cycleCounter);
+  } else if (protocol == Cache::HYBRID) {
+    m_memorySystemPtr = std::make_unique<Cache::HybridMemorySystem>(config.geometry, numCores, memoryConfig, m_report, m_cycleCounter);
+  } else if (protocol == Cache::MESIF) {
+    m_memorySystemPtr = std::make_unique<Cache::MesifMemorySystem>(config.geometry, numCores, memoryConfig, m_report, m_cycleCounter);
+  } else if (protocol == Cache::MSI) {
+    m_memorySystemPtr = std::make_unique<Cache::MsiMemorySystem>(config.geometry, numCores, memoryConfig, m_report, m_cycleCounter);
+  } else if (protocol == Cache::DIRECTORY) {
+    m_memorySystemPtr = std::make_unique<Cache::DirectoryMemorySystem>(config.geometry, numCores, memoryConfig, m_report, m_cycleCounter);
   } else {
     printf("Invalid cache coherence protocol used\n");
   }
+  m_report.storeBufferDepth = m_storeBufferDepth;
+
+  selectRunFn(protocol, config.useStaticDispatch);
+  if ((m_instructionWindow > 0 || m_storeBufferDepth > 0) && m_engineMode == QUANTUM) {
+    m_engineMode = EVENT; // running ahead assumes cores block on the bus
+  }
+  if (config.memoryConfig.prefetcher.type != Prefetch::NONE && m_engineMode == QUANTUM) {
+    m_engineMode = EVENT; // and that only the bus fills lines the cores are about to hit
+  }
 }
 
-bool CPU::isFinishedExecuting() const {
+CPU::CPU(std::shared_ptr<const std::vector<std::vector<Architecture::Instruction>>> instructionsByCorePtr, const CPUConfig& config) : CPU(instructionsByCorePtr->size(), config) {
+  m_instructionsByCorePtr = std::move(instructionsByCorePtr);
+  for (int i = 0; i < m_cores.size(); ++i) {
+    m_cores[i].instructions = (*m_instructionsByCorePtr)[i];
+    m_cores[i].state = m_cores[i].instructions.empty() ? COMPLETED : LOADING;
+    m_numCompletedCores += (m_cores[i].state == COMPLETED);
+  }
+}
+
+CPU::CPU(std::vector<std::unique_ptr<Architecture::InstructionStream>>&& streamsByCore, const CPUConfig& config) : CPU(streamsByCore.size(), config) {
+  if (m_engineMode == QUANTUM) {
+    m_engineMode = EVENT; // streams can not be looked ahead
+  }
+  if (m_instructionWindow > 0) {
+    m_instructionWindow = 0; // nor can their window
+    selectRunFn(config.protocol, config.useStaticDispatch);
+  }
+  for (int i = 0; i < m_cores.size(); ++i) {
+    m_cores[i].stream = std::move(streamsByCore[i]);
+    m_cores[i].instructions = std::span(&m_cores[i].streamedInst, 1); // m_cores is never resized, so the span stays valid
+    m_cores[i].state = m_cores[i].stream->pop(m_cores[i].streamedInst) ? LOADING : COMPLETED; // fetch the first instruction
+    m_numCompletedCores += (m_cores[i].state == COMPLETED);
+  }
+}
+
+bool CPU::hasStreamFailed() const {
   for (const Core& core : m_cores) {
-    if (core.state != COMPLETED) {
-      return false;
+    if (core.stream && core.stream->hasFailed()) {
+      return true;
     }
   }
-  return true;
+  return false;
+}
+
+bool CPU::isFinishedExecuting() const {
+  return m_numCompletedCores == m_cores.size();
+}
+
+void CPU::advanceCore(Core& core) {
+  core.state = core.advance() ? LOADING : COMPLETED; // set state to completed if instructions finished, else set state to loading
+  if (core.state == COMPLETED && !core.storeBuffer.empty()) {
+    core.state = DRAINING;
+    core.isOutOfInstructions = true;
+  }
+  m_numCompletedCores += (core.state == COMPLETED);
+}
+
+void CPU::selectRunFn(const Cache::COHERENCE_PROTOCOL protocol, const bool useStaticDispatch) {
+  if (useStaticDispatch && protocol == Cache::MESI) {
+    selectRunFnForCores<Cache::MesiMemorySystem>();
+  } else if (useStaticDispatch && protocol == Cache::DRAGON) {
+    selectRunFnForCores<Cache::DragonMemorySystem>();
+  } else if (useStaticDispatch && protocol == Cache::MOESI) {
+    selectRunFnForCores<Cache::MOESIMemorySystem>();
+  } else {
+    selectRunFnForCores<Cache::MemorySystem>();
+  }
+}
+
+template <typename Protocol>
+void CPU::selectRunFnForCores() {
+  if (m_instructionWindow > 0) {
+    m_runFn = &CPU::run<Protocol, NON_BLOCKING_CORES>;
+    return;
+  }
+  switch (m_cores.size()) {
+  case 1: m_runFn = &CPU::run<Protocol, 1>; break;
+  case 2: m_runFn = &CPU::run<Protocol, 2>; break;
+  case 4: m_runFn = &CPU::run<Protocol, 4>; break;
+  case 8: m_runFn = &CPU::run<Protocol, 8>; break;
+  case 16: m_runFn = &CPU::run<Protocol, 16>; break;
+  case 32: m_runFn = &CPU::run<Protocol, 32>; break;
+  case 64: m_runFn = &CPU::run<Protocol, 64>; break;
+  default: m_runFn = &CPU::run<Protocol, 0>; break;
+  }
 }
 
 void CPU::simulate() {
-  Architecture::GlobalCycleCounter::initialiseCounter();
+  m_cycleCounter.initialiseCounter();
+  m_report.clearReport(m_cores.size());
+  // Reused every tick, sized up front so the loop does not allocate
   std::vector<Cache::MemoryRequest> pendingMemoryRequests;
   std::vector<Cache::MemoryRequest> completedMemoryRequests;
+  pendingMemoryRequests.reserve(m_cores.size());
+  completedMemoryRequests.reserve(m_cores.size());
+  (this->*m_runFn)(pendingMemoryRequests, completedMemoryRequests);
+  m_report.overallExecutionCycles = m_cycleCounter.getCounter();
+  m_memorySystemPtr->finaliseReport();
+}
+
+template <typename Protocol, int FIXED_NUM_CORES>
+void CPU::run(std::vector<Cache::MemoryRequest>& pendingMemoryRequests, std::vector<Cache::MemoryRequest>& completedMemoryRequests) {
   while (!isFinishedExecuting()) {
-    // Reset vectors
-    pendingMemoryRequests.clear();
-    completedMemoryRequests.clear();
-    // Update Instructions
-    for (int coreIdx = 0; coreIdx < Architecture::NUM_CORES; ++coreIdx) {
-      Core& core = m_cores[coreIdx];
-      if (core.state == COMPLETED) {
-        continue; // do nothing if already completed
+    if (m_engineMode == QUANTUM) {
+      runQuantum();
+      if (isFinishedExecuting()) {
+        break;
+      }
+    }
+    if (m_engineMode != CYCLE) {
+      int cycles = cyclesUntilNextEvent();
+      if (cycles > 0) {
+        skipCycles(cycles);
       }
+    }
+    tick<Protocol, FIXED_NUM_CORES>(pendingMemoryRequests, completedMemoryRequests);
+  }
+}
+
+template <int FIXED_NUM_CORES>
+void CPU::tickCores(std::vector<Cache::MemoryRequest>& pendingMemoryRequests) {
+  const int numCores = FIXED_NUM_CORES ? FIXED_NUM_CORES : m_cores.size();
+  Core* cores = m_cores.data();
+  for (int coreIdx = 0; coreIdx < numCores; ++coreIdx) {
+    Core& core = cores[coreIdx];
+    if (core.state == COMPLETED) {
+      continue; // do nothing if already completed
+    }
+
+    ++core.executionCycles; // increment execution cycles of instruction
+    if (core.state == BLOCKED || core.state == DRAINING) {
+      continue;
+    }
+
+    const Architecture::Instruction& instruction = core.currentInstruction();
+    if (core.state == LOADING) {
+      // core has finished executing, set to completed and continue
+      if (instruction.instType == Architecture::COMPUTE) {
+        m_report.numComputeInstructions[coreIdx] += instruction.numCoalesced;
+        core.state = EXECUTING;
+      } else if (m_storeBufferDepth > 0) {
+        issueWithStoreBuffer(core, coreIdx, instruction, pendingMemoryRequests);
+      } else if (instruction.instType == Architecture::LOAD || instruction.instType == Architecture::STORE) {
+        ++m_report.numLoadStoreInstructions[coreIdx];
+        pendingMemoryRequests.emplace_back(coreIdx, instruction.instType, instruction.dataAddress); // enqueue memory request
+        core.state = BLOCKED;
+      }
+    }
+
+    if (core.state == EXECUTING) {
+      if (core.executionCycles >= instruction.computeCycles) { // complete execution of compute
+        m_report.computeCycles[coreIdx] += core.executionCycles;
+        advanceCore(core);
+      }
+    }
+  }
+}
 
-      Architecture::Instruction& instruction = core.instructions[core.currInst];
-      ++instruction.executionCycles; // increment execution cycles of instruction
-
-      if (core.state == LOADING) {
-        // core has finished executing, set to completed and continue
-        if (core.instructions[core.currInst].instType == Architecture::COMPUTE) {
-          ++Architecture::GlobalReport::numComputeInstructions[coreIdx];
-          core.state = EXECUTING;
-        } else if (core.instructions[core.currInst].instType == Architecture::LOAD || core.instructions[core.currInst].instType == Architecture::STORE) {
-          ++Architecture::GlobalReport::numLoadStoreInstructions[coreIdx];
-          pendingMemoryRequests.emplace_back(coreIdx, instruction.instType, instruction.dataAddress); // enqueue memory request
+void CPU::tickNonBlockingCores(std::vector<Cache::MemoryRequest>& pendingMemoryRequests) {
+  for (int coreIdx = 0; coreIdx < m_cores.size(); ++coreIdx) {
+    Core& core = m_cores[coreIdx];
+    if (core.state == COMPLETED) {
+      continue;
+    }
+    if (core.state == BLOCKED) {
+      ++m_report.idleCycles[coreIdx]; // until a memory instruction completes
+      continue;
+    }
+
+    const Architecture::Instruction& instruction = core.currentInstruction();
+    if (core.state == LOADING) {
+      const bool isWindowFull = !core.outstandingInsts.empty() && core.currInst - *std::min_element(core.outstandingInsts.begin(), core.outstandingInsts.end()) >= m_instructionWindow;
+      if (isWindowFull) {
+        ++m_report.idleCycles[coreIdx];
+        core.state = BLOCKED;
+        continue;
+      }
+
+      if (instruction.instType == Architecture::COMPUTE) {
+        m_report.numComputeInstructions[coreIdx] += instruction.numCoalesced;
+        core.state = EXECUTING;
+      } else {
+        const Cache::MemoryRequest request(coreIdx, instruction.instType, instruction.dataAddress, core.currInst);
+        ++m_report.idleCycles[coreIdx]; // issuing takes the cycle whether or not the cache can take the request
+        if (!m_memorySystemPtr->canAcceptRequest(request)) {
           core.state = BLOCKED;
+          continue;
         }
+        ++m_report.numLoadStoreInstructions[coreIdx];
+        pendingMemoryRequests.push_back(request);
+        core.outstandingInsts.push_back(core.currInst);
+        advanceNonBlockingCore(core);
+        continue;
       }
+    }
 
-      if (core.state == EXECUTING) {
-        if (instruction.executionCycles >= instruction.computeCycles) { // complete execution of compute
-          Architecture::GlobalReport::computeCycles[coreIdx] += instruction.executionCycles;
-          ++core.currInst;
-          core.state = (core.currInst >= core.instructions.size()) ? COMPLETED : LOADING; // set state to completed if instructions finished, else set state to loading
-        }
+    ++core.executionCycles;
+    if (core.executionCycles >= instruction.computeCycles) { // complete execution of compute
+      m_report.computeCycles[coreIdx] += core.executionCycles;
+      advanceNonBlockingCore(core);
+    }
+  }
+}
+
+void CPU::advanceNonBlockingCore(Core& core) {
+  if (core.advance()) {
+    core.state = LOADING;
+  } else { // out of instructions, but only complete once every memory instruction has
+    core.state = core.outstandingInsts.empty() ? COMPLETED : BLOCKED;
+    m_numCompletedCores += (core.state == COMPLETED);
+  }
+}
+
+void CPU::issueWithStoreBuffer(Core& core, const int coreIdx, const Architecture::Instruction& instruction, std::vector<Cache::MemoryRequest>& pendingMemoryRequests) {
+  if (instruction.instType == Architecture::STORE) {
+    if (core.storeBuffer.size() >= m_storeBufferDepth) {
+      core.state = DRAINING; // retried once the oldest store drains
+      return;
+    }
+    core.storeBuffer.emplace(coreIdx, instruction.instType, instruction.dataAddress, core.currInst);
+  } else if (core.storeBuffer.anyOf([&](const Cache::MemoryRequest& store) {return store.address == instruction.dataAddress;})) {
+    ++m_report.numForwardedLoads[coreIdx];
+  } else {
+    const Cache::MemoryRequest request(coreIdx, instruction.instType, instruction.dataAddress, core.currInst);
+    if (!m_memorySystemPtr->canAcceptRequest(request)) {
+      return; // the draining store holds the way it needs, retry next cycle
+    }
+    ++m_report.numLoadStoreInstructions[coreIdx];
+    pendingMemoryRequests.push_back(request);
+    core.state = BLOCKED;
+    return;
+  }
+  // Retired without the cache, taking a cycle like a hit
+  ++m_report.numLoadStoreInstructions[coreIdx];
+  m_report.idleCycles[coreIdx] += core.executionCycles;
+  advanceCore(core);
+}
+
+void CPU::drainStoreBuffers(std::vector<Cache::MemoryRequest>& pendingMemoryRequests) {
+  // Cores issue in core order, only drain a core's store on ticks it issued nothing else so canAcceptRequest has seen
+  // every other request that could take the same MSHR or way
+  const int numIssued = pendingMemoryRequests.size();
+  int issuedIdx = 0;
+  for (int coreIdx = 0; coreIdx < m_cores.size(); ++coreIdx) {
+    Core& core = m_cores[coreIdx];
+    const int occupancy = core.storeBuffer.size();
+    m_report.storeBufferOccupancySum[coreIdx] += occupancy;
+    m_report.storeBufferMaxOccupancy[coreIdx] = std::max(m_report.storeBufferMaxOccupancy[coreIdx], occupancy);
+
+    while (issuedIdx < numIssued && pendingMemoryRequests[issuedIdx].coreNum < coreIdx) {
+      ++issuedIdx;
+    }
+    const bool hasIssued = issuedIdx < numIssued && pendingMemoryRequests[issuedIdx].coreNum == coreIdx;
+    if (core.storeBuffer.empty() || core.isDrainingStore || hasIssued || !m_memorySystemPtr->canAcceptRequest(core.storeBuffer.front())) {
+      continue;
+    }
+    pendingMemoryRequests.push_back(core.storeBuffer.front());
+    core.isDrainingStore = true;
+  }
+}
+
+void CPU::completeStoreDrain(Core& core, const int coreIdx) {
+  core.storeBuffer.pop();
+  core.isDrainingStore = false;
+  if (core.state != DRAINING) {
+    return;
+  }
+  m_report.idleCycles[coreIdx] += core.executionCycles;
+  if (core.isOutOfInstructions) {
+    core.state = core.storeBuffer.empty() ? COMPLETED : DRAINING;
+    m_numCompletedCores += (core.state == COMPLETED);
+  } else {
+    m_report.storeBufferFullStallCycles[coreIdx] += core.executionCycles;
+    core.state = LOADING; // retry the store
+  }
+  core.executionCycles = 0;
+}
+
+template <typename Protocol, int FIXED_NUM_CORES>
+void CPU::tick(std::vector<Cache::MemoryRequest>& pendingMemoryRequests, std::vector<Cache::MemoryRequest>& completedMemoryRequests) {
+  // Reset vectors
+  pendingMemoryRequests.clear();
+  completedMemoryRequests.clear();
+  // Update Instructions
+  if constexpr (FIXED_NUM_CORES == NON_BLOCKING_CORES) {
+    tickNonBlockingCores(pendingMemoryRequests);
+  } else {
+    tickCores<FIXED_NUM_CORES>(pendingMemoryRequests);
+  }
+  if (m_storeBufferDepth > 0) {
+    drainStoreBuffers(pendingMemoryRequests);
+  }
+  const uint32_t cycle = uint32_t(m_cycleCounter.getCounter());
+  for (Cache::MemoryRequest& request : pendingMemoryRequests) {
+    request.issueCycle = cycle;
+  }
+
+  m_memorySystemPtr->tickMemorySystem<Protocol>(pendingMemoryRequests, completedMemoryRequests);
+
+  // Increment to next instruction for finished memory requests
+  for (const Cache::MemoryRequest& request : completedMemoryRequests) {
+    Core& core = m_cores[request.coreNum];
+    m_report.requestLatencyByCore[request.coreNum][request.source].record(cycle - request.issueCycle + 1); // counting the issue cycle
+    if (m_instructionWindow > 0) {
+      core.outstandingInsts.erase(std::find(core.outstandingInsts.begin(), core.outstandingInsts.end(), request.instIdx));
+      if (core.state == BLOCKED) { // retry whatever the core stalled on
+        core.state = (core.currInst < core.instructions.size()) ? LOADING : (core.outstandingInsts.empty() ? COMPLETED : BLOCKED);
+        m_numCompletedCores += (core.state == COMPLETED);
       }
+      continue;
+    }
+    if (m_storeBufferDepth > 0 && request.type == Architecture::STORE) { // only buffered stores are issued as stores
+      completeStoreDrain(core, request.coreNum);
+      continue;
+    }
+    // Report idle cycles
+    m_report.idleCycles[request.coreNum] += core.executionCycles;
+    advanceCore(core);
+  }
+  m_cycleCounter.incrementCounter(); // increment global cycle Counter
+}
+
+int CPU::cyclesUntilNextEvent() const {
+  int cycles = m_memorySystemPtr->cyclesUntilNextEvent();
+  for (const Core& core : m_cores) {
+    if (core.state == LOADING || (!core.storeBuffer.empty() && !core.isDrainingStore)) {
+      return 0; // core issues its next instruction or store on the next tick
+    }
+    if (core.state == EXECUTING) {
+      cycles = std::min(cycles, core.currentInstruction().computeCycles - core.executionCycles - 1); // compute completes on the tick execution cycles reach compute cycles
+    }
+  }
+  return (cycles == std::numeric_limits<int>::max()) ? 0 : cycles;
+}
+
+void CPU::skipCycles(const long long cycles) {
+  // Executing and blocked cores accumulate cycles on their current instruction, reported when it completes
+  for (int coreIdx = 0; coreIdx < m_cores.size(); ++coreIdx) {
+    Core& core = m_cores[coreIdx];
+    if (core.state == BLOCKED && m_instructionWindow > 0) {
+      m_report.idleCycles[coreIdx] += cycles; // stalled non blocking cores count idle cycles as they go
+    } else if (core.state == EXECUTING || core.state == BLOCKED || core.state == DRAINING) {
+      core.executionCycles += cycles;
+    }
+    if (m_storeBufferDepth > 0) {
+      m_report.storeBufferOccupancySum[coreIdx] += (long long)core.storeBuffer.size() * cycles;
+    }
+  }
+  m_memorySystemPtr->skipCycles(cycles);
+  m_cycleCounter.advanceCounter(cycles);
+}
+
+void CPU::runQuantum() {
+  constexpr long long NO_HORIZON = std::numeric_limits<long long>::max();
+  const long long now = m_cycleCounter.getCounter();
+  const int busCycles = m_memorySystemPtr->cyclesUntilBusEvent();
+  long long horizon = (busCycles == std::numeric_limits<int>::max()) ? NO_HORIZON : now + busCycles;
+  for (int coreIdx = 0; coreIdx < m_cores.size() && horizon > now; ++coreIdx) {
+    horizon = std::min(horizon, lookAhead(m_cores[coreIdx], coreIdx, horizon));
+  }
+  if (horizon == now) {
+    return; // something happens on the next tick, leave it to the lockstep engine
+  }
+
+  long long endCycle = now;
+  for (int coreIdx = 0; coreIdx < m_cores.size(); ++coreIdx) {
+    endCycle = std::max(endCycle, runAhead(m_cores[coreIdx], coreIdx, horizon));
+  }
+  // With no horizon every core ran to completion, the simulation ends the cycle after the last core finished
+  const long long cycles = ((horizon == NO_HORIZON) ? endCycle : horizon) - now;
+  m_memorySystemPtr->skipCycles(cycles);
+  m_cycleCounter.advanceCounter(cycles);
+}
+
+long long CPU::lookAhead(Core& core, const int coreIdx, const long long horizon) {
+  if (core.state == BLOCKED || core.state == COMPLETED) {
+    return std::numeric_limits<long long>::max(); // blocked cores only resume after a bus event
+  }
+
+  const long long numSnoopHits = m_memorySystemPtr->getNumSnoopHits(coreIdx);
+  const bool isAheadOfCore = core.lookaheadInst > core.currInst || (core.lookaheadInst == core.currInst && core.state == LOADING);
+  long long cycle = m_cycleCounter.getCounter(); // cycle the core loads instruction instIdx on
+  int instIdx = core.currInst;
+  if (core.lookaheadSnoopHits == numSnoopHits && isAheadOfCore) { // resume the previous lookahead
+    if (core.lookaheadNeedsBus) {
+      return core.lookaheadCycle;
+    }
+    cycle = core.lookaheadCycle;
+    instIdx = core.lookaheadInst;
+  } else if (core.state == EXECUTING) {
+    cycle += core.currentInstruction().computeCycles - core.executionCycles;
+    ++instIdx;
+  }
+
+  core.lookaheadNeedsBus = false;
+  for (; instIdx < core.instructions.size() && cycle < horizon; ++instIdx) {
+    const Architecture::Instruction& instruction = core.instructions[instIdx];
+    if (instruction.instType == Architecture::COMPUTE) {
+      cycle += std::max(instruction.computeCycles, 1);
+    } else if (m_memorySystemPtr->isLocalHit(Cache::MemoryRequest(coreIdx, instruction.instType, instruction.dataAddress))) {
+      cycle += Cache::L1_CACHE_HIT_CYCLES;
+    } else {
+      core.lookaheadNeedsBus = true;
+      break;
     }
+  }
+  core.lookaheadInst = instIdx;
+  core.lookaheadCycle = cycle;
+  core.lookaheadSnoopHits = numSnoopHits;
+  return (core.lookaheadNeedsBus || instIdx < core.instructions.size()) ? cycle : std::numeric_limits<long long>::max();
+}
 
-    m_memorySystemPtr->tickMemorySystem(pendingMemoryRequests, completedMemoryRequests);
+long long CPU::runAhead(Core& core, const int coreIdx, const long long horizon) {
+  long long cycle = m_cycleCounter.getCounter(); // cycle the core loads instruction currInst on
+  if (core.state == BLOCKED) {
+    core.executionCycles += horizon - cycle; // reported as idle once the request completes
+    return cycle;
+  }
+  if (core.state == COMPLETED) {
+    return cycle;
+  }
 
-    // Increment to next instruction for finished memory requests
-    for (const Cache::MemoryRequest& request : completedMemoryRequests) {
-      Core& core = m_cores[request.coreNum];
-      // Report idle cycles
-      Architecture::GlobalReport::idleCycles[request.coreNum] += core.instructions[core.currInst].executionCycles;
-      ++core.currInst;
-      core.state = (core.currInst >= core.instructions.size()) ? COMPLETED : LOADING; // set state to completed if instructions finished, else set state to loading
+  if (core.state == EXECUTING) {
+    const Architecture::Instruction& instruction = core.currentInstruction();
+    const long long completionCycle = cycle + instruction.computeCycles - core.executionCycles - 1;
+    if (completionCycle >= horizon) {
+      core.executionCycles += horizon - cycle;
+      return horizon;
     }
-    Architecture::GlobalCycleCounter::incrementCounter(); // increment global cycle Counter
+    m_report.computeCycles[coreIdx] += instruction.computeCycles;
+    cycle = completionCycle + 1;
+    ++core.currInst;
   }
-  Architecture::GlobalReport::overallExecutionCycles = Architecture::GlobalCycleCounter::getCounter();
+
+  // Same accounting as tickCores and tick, but for a whole instruction at a time
+  core.executionCycles = 0;
+  core.state = LOADING;
+  for (; core.currInst < core.instructions.size(); ++core.currInst) {
+    if (cycle >= horizon) {
+      return horizon;
+    }
+    const Architecture::Instruction& instruction = core.instructions[core.currInst];
+    if (instruction.instType == Architecture::COMPUTE) {
+      const int cycles = std::max(instruction.computeCycles, 1);
+      m_report.numComputeInstructions[coreIdx] += instruction.numCoalesced;
+      if (cycle + cycles - 1 >= horizon) { // still executing at the horizon
+        core.executionCycles = horizon - cycle;
+        core.state = EXECUTING;
+        return horizon;
+      }
+      m_report.computeCycles[coreIdx] += cycles;
+      cycle += cycles;
+    } else {
+      ++m_report.numLoadStoreInstructions[coreIdx];
+      m_memorySystemPtr->serviceLocalHit(Cache::MemoryRequest(coreIdx, instruction.instType, instruction.dataAddress));
+      m_report.idleCycles[coreIdx] += Cache::L1_CACHE_HIT_CYCLES;
+      m_report.requestLatencyByCore[coreIdx][Architecture::L1_HIT].record(Cache::L1_CACHE_HIT_CYCLES);
+      cycle += Cache::L1_CACHE_HIT_CYCLES;
+    }
+  }
+
+  core.state = COMPLETED;
+  ++m_numCompletedCores;
+  return cycle;
 }
 
-} //namespace
\ No newline at end of file
+
+} //namespace
@@ -1,6 +1,6 @@
 #pragma once
-#include <array>
 #include <memory>
+#include <span>
 #include <vector>
 
 #include "architecture.h"
@@ -10,27 +10,141 @@ namespace Processor {
 enum EXECUTION_STATE {
   LOADING,
   EXECUTING, // Compute Instruction
-  BLOCKED, // Load/Store Instruction
+  BLOCKED, // Load/Store Instruction, or a non blocking core waiting for a memory instruction to complete
+  DRAINING, // Store waiting for space in a full store buffer, or a core out of instructions waiting for it to empty
   COMPLETED
 };
 
+enum ENGINE_MODE {
+  CYCLE, // tick every cycle
+  EVENT, // jump straight to the next cycle where a core or memory request changes state
+  QUANTUM // as EVENT, but cores also run ahead through compute and local hits until the bus next changes any cache
+};
+
+// Everything needed to set up a simulation besides its instructions
+struct CPUConfig {
+  Cache::COHERENCE_PROTOCOL protocol = Cache::MESI;
+  Cache::CacheGeometry geometry;
+  ENGINE_MODE engineMode = CYCLE;
+  Cache::MemorySystemConfig memoryConfig;
+  // Non blocking cores run up to this many trace entries past their oldest incomplete memory instruction, needs
+  // MSHRs in the memory config. 0 blocks on every memory instruction
+  int instructionWindow = 0;
+  // Blocking cores retire stores into a FIFO store buffer of this depth, drained to the cache in the background. 0 for
+  // no store buffer, can not be combined with an instruction window
+  int storeBufferDepth = 0;
+  // MESI, Dragon and MOESI ticks call the protocol handlers directly so they can be inlined, false always goes
+  // through the vtable
+  bool useStaticDispatch = true;
+};
+
+constexpr int STORE_BUFFER_MSHRS = 2; // one for the core's blocked load, one for the store being drained
+constexpr int NON_BLOCKING_CORES = -1; // in place of a core count, ticks the cores with tickNonBlockingCores
+
 struct Core {
-  std::vector<Architecture::Instruction> instructions;
+  std::span<const Architecture::Instruction> instructions; // owned by the CPU's shared trace, or just streamedInst when streaming
+  std::unique_ptr<Architecture::InstructionStream> stream; // if set, instructions are consumed from the stream instead
+  Architecture::Instruction streamedInst = Architecture::Instruction(Architecture::COMPUTE, 0); // current instruction when streaming
   int currInst = 0;
+  int executionCycles = 0; // cycles spent on the current instruction
   EXECUTION_STATE state = LOADING;
+
+  // Quantum engine lookahead: instruction lookaheadInst loads on lookaheadCycle with only compute and local hits before
+  // it. Stays valid until the core passes it or a bus transaction snoops one of its lines, so lookaheads can resume from it
+  int lookaheadInst = 0;
+  long long lookaheadCycle = 0;
+  bool lookaheadNeedsBus = false; // lookaheadInst is a request needing the bus, not just where the last lookahead stopped
+  long long lookaheadSnoopHits = -1; // snoop hits on the core's cache when the lookahead was made
+
+  std::vector<int> outstandingInsts; // non blocking: trace positions of issued memory instructions not yet complete
+
+  Cache::RingQueue<Cache::MemoryRequest> storeBuffer; // retired stores oldest first, the front is the one drained next
+  bool isDrainingStore = false; // the front of the store buffer has been issued to the cache
+  bool isOutOfInstructions = false; // only completes once the store buffer is empty
+
+  const Architecture::Instruction& currentInstruction() const {return instructions[currInst];}
+
+  // Moves to the next instruction, returns false if there are no instructions left. A streaming core's span only
+  // holds the current instruction, so the stream is only read once the span runs out and currInst never overflows
+  bool advance() {
+    executionCycles = 0;
+    if (++currInst < instructions.size()) {
+      return true;
+    }
+    if (!stream || !stream->pop(streamedInst)) {
+      return false;
+    }
+    currInst = 0;
+    return true;
+  }
 };
 
 class CPU {
 public:
-  CPU(std::array<std::vector<Architecture::Instruction>, Architecture::NUM_CORES>&& instructionsByCore, Cache::COHERENCE_PROTOCOL protocol);
+  // One core is created per instruction vector or stream, the instructions are only read so can be shared between CPUs
+  CPU(std::shared_ptr<const std::vector<std::vector<Architecture::Instruction>>> instructionsByCorePtr, const CPUConfig& config);
+  CPU(std::vector<std::unique_ptr<Architecture::InstructionStream>>&& streamsByCore, const CPUConfig& config);
 
   bool isFinishedExecuting() const;
+  // False if the protocol was not recognised, the CPU then has no memory system to simulate
+  bool isValid() const {return m_memorySystemPtr != nullptr;}
 
   void simulate();
 
+  // True if any streamed trace failed to parse part way through the simulation
+  bool hasStreamFailed() const;
+
+  const Architecture::GlobalReport& getReport() const {return m_report;}
+
 
 private:
-  std::array<Core, Architecture::NUM_CORES> m_cores;
+  CPU(const int numCores, const CPUConfig& config);
+
+  // Chooses the instantiation of run for the protocol and cores, so each tick calls everything directly
+  void selectRunFn(const Cache::COHERENCE_PROTOCOL protocol, const bool useStaticDispatch);
+  template <typename Protocol>
+  void selectRunFnForCores();
+  // Ticks until every core completes. Protocol is the exact type of the memory system, or Cache::MemorySystem for
+  // virtual calls. FIXED_NUM_CORES is as for tickCores, or NON_BLOCKING_CORES
+  template <typename Protocol, int FIXED_NUM_CORES>
+  void run(std::vector<Cache::MemoryRequest>& pendingMemoryRequests, std::vector<Cache::MemoryRequest>& completedMemoryRequests);
+  template <typename Protocol, int FIXED_NUM_CORES>
+  void tick(std::vector<Cache::MemoryRequest>& pendingMemoryRequests, std::vector<Cache::MemoryRequest>& completedMemoryRequests);
+  // Steps every core by a cycle, FIXED_NUM_CORES lets the loop be unrolled for common core counts, 0 for any count
+  template <int FIXED_NUM_CORES>
+  void tickCores(std::vector<Cache::MemoryRequest>& pendingMemoryRequests);
+  // tickCores for non blocking cores, which only stall when their window or MSHRs are full
+  void tickNonBlockingCores(std::vector<Cache::MemoryRequest>& pendingMemoryRequests);
+  void advanceNonBlockingCore(Core& core);
+  // Retires a store into the store buffer or forwards a load from it, otherwise issues the load to the cache
+  void issueWithStoreBuffer(Core& core, const int coreIdx, const Architecture::Instruction& instruction, std::vector<Cache::MemoryRequest>& pendingMemoryRequests);
+  // Issues the oldest buffered store of each core not already draining one
+  void drainStoreBuffers(std::vector<Cache::MemoryRequest>& pendingMemoryRequests);
+  void completeStoreDrain(Core& core, const int coreIdx);
+  // Moves the core to its next instruction, completing it if there are none left
+  void advanceCore(Core& core);
+  // Number of upcoming ticks in which no core or memory request changes state
+  int cyclesUntilNextEvent() const;
+  void skipCycles(const long long cycles);
+  // Runs every core through compute and local hits up to the next cycle that any core needs the bus or the bus
+  // processes or completes a transaction, so no core can observe the others running ahead
+  void runQuantum();
+  // Cycle the core next needs the bus on, max long long if never. Looks no further than the horizon, returning a
+  // cycle at or past it if the core does not need the bus before then
+  long long lookAhead(Core& core, const int coreIdx, const long long horizon);
+  // Executes the core's compute and local hits up to the horizon, which must not be past its lookahead.
+  // Returns the cycle after its last instruction if it completes, else the horizon
+  long long runAhead(Core& core, const int coreIdx, const long long horizon);
+
+  ENGINE_MODE m_engineMode;
+  int m_instructionWindow; // 0 for blocking cores
+  int m_storeBufferDepth; // 0 without store buffers
+  Architecture::GlobalReport m_report;
+  Architecture::GlobalCycleCounter m_cycleCounter;
+  std::shared_ptr<const std::vector<std::vector<Architecture::Instruction>>> m_instructionsByCorePtr;
+  std::vector<Core> m_cores;
+  int m_numCompletedCores = 0;
+  void (CPU::*m_runFn)(std::vector<Cache::MemoryRequest>&, std::vector<Cache::MemoryRequest>&); // chosen once, called once per simulation
   std::unique_ptr<Cache::MemorySystem> m_memorySystemPtr;
 };
 } // Processor namespace
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include "replacement.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+
+namespace Replacement {
+
+namespace {
+  bool isReserved(const std::vector<int>& reservedWays, const int blockIdx) {
+    return std::find(reservedWays.begin(), reservedWays.end(), blockIdx) != reservedWays.end();
+  }
+
+  // First way from blockIdx onwards, wrapping around, that is not reserved
+  int skipReserved(const std::vector<int>& reservedWays, int blockIdx, const int associativity) {
+    while (isReserved(reservedWays, blockIdx)) {
+      blockIdx = (blockIdx + 1) % associativity;
+    }
+    return blockIdx;
+  }
+}
+
+std::string toString(REPLACEMENT_POLICY policy) {
+  switch (policy) {
+    case LRU:
+      return LRU_STRING;
+    case TREE_PLRU:
+      return TREE_PLRU_STRING;
+    case SRRIP:
+      return SRRIP_STRING;
+    case BRRIP:
+      return BRRIP_STRING;
+    case RANDOM:
+      return RANDOM_STRING;
+  }
+  return "Unknown Replacement Policy";
+}
+
+bool isSupported(const REPLACEMENT_POLICY policy, const int associativity) {
+  if (policy == LRU && associativity > MAX_LRU_ASSOCIATIVITY) {
+    std::fprintf(stderr, "Error: %s replacement supports an associativity of at most %d, not %d\n", LRU_STRING, MAX_LRU_ASSOCIATIVITY, associativity);
+    return false;
+  }
+  if (policy == TREE_PLRU && !std::has_single_bit(unsigned(associativity))) {
+    std::fprintf(stderr, "Error: %s replacement needs a power of two associativity, not %d\n", TREE_PLRU_STRING, associativity);
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<ReplacementPolicy> makeReplacementPolicy(const REPLACEMENT_POLICY policy, const int numSets, const int associativity) {
+  switch (policy) {
+    case LRU:
+      return std::make_unique<LruPolicy>(numSets, associativity);
+    case TREE_PLRU:
+      return std::make_unique<TreePlruPolicy>(numSets, associativity);
+    case SRRIP:
+      return std::make_unique<RripPolicy>(numSets, associativity, false);
+    case BRRIP:
+      return std::make_unique<RripPolicy>(numSets, associativity, true);
+    case RANDOM:
+      return std::make_unique<RandomPolicy>(associativity);
+  }
+  return nullptr;
+}
+
+LruPolicy::LruPolicy(const int numSets, const int associativity) : m_associativity(associativity),
+    m_prev(size_t(numSets) * associativity), m_next(size_t(numSets) * associativity), m_mru(numSets, associativity - 1), m_lru(numSets, 0) {
+  // Start with the lowest way least recently used, as ties between equal cycle stamps used to resolve
+  for (size_t setStart = 0; setStart < m_prev.size(); setStart += associativity) {
+    for (int blockIdx = 0; blockIdx < associativity; ++blockIdx) {
+      m_prev[setStart + blockIdx] = blockIdx + 1; // towards the most recently used
+      m_next[setStart + blockIdx] = blockIdx - 1; // towards the least recently used
+    }
+  }
+}
+
+void LruPolicy::touch(const uint32_t setIdx, const int blockIdx) {
+  const uint16_t mru = m_mru[setIdx];
+  if (mru == blockIdx) {
+    return;
+  }
+  const size_t setStart = size_t(setIdx) * m_associativity;
+  // Unlink, the way is not the most recently used so has a more recent neighbour
+  const uint16_t moreRecent = m_prev[setStart + blockIdx];
+  const uint16_t lessRecent = m_next[setStart + blockIdx];
+  m_next[setStart + moreRecent] = lessRecent;
+  if (m_lru[setIdx] == blockIdx) {
+    m_lru[setIdx] = moreRecent;
+  } else {
+    m_prev[setStart + lessRecent] = moreRecent;
+  }
+  // Push in front of the most recently used
+  m_next[setStart + blockIdx] = mru;
+  m_prev[setStart + mru] = blockIdx;
+  m_mru[setIdx] = blockIdx;
+}
+
+int LruPolicy::findVictim(const uint32_t setIdx, const std::vector<int>& reservedWays) {
+  const size_t setStart = size_t(setIdx) * m_associativity;
+  int blockIdx = m_lru[setIdx];
+  while (isReserved(reservedWays, blockIdx)) {
+    blockIdx = m_prev[setStart + blockIdx];
+  }
+  return blockIdx;
+}
+
+TreePlruPolicy::TreePlruPolicy(const int numSets, const int associativity) : m_associativity(associativity),
+    m_numLevels(std::countr_zero(unsigned(associativity))), m_bits((size_t(numSets) * associativity + 63) / 64, 0) {}
+
+void TreePlruPolicy::touch(const uint32_t setIdx, const int blockIdx) {
+  // Node n of a set is bit setIdx * associativity + n, node 0 is unused
+  const size_t setStart = size_t(setIdx) * m_associativity;
+  int node = 1;
+  for (int level = m_numLevels - 1; level >= 0; --level) {
+    const int isRight = (blockIdx >> level) & 1;
+    const size_t bitIdx = setStart + node;
+    if (isRight) { // point the victim search away from the way
+      m_bits[bitIdx / 64] &= ~(uint64_t(1) << (bitIdx % 64));
+    } else {
+      m_bits[bitIdx / 64] |= uint64_t(1) << (bitIdx % 64);
+    }
+    node = 2 * node + isRight;
+  }
+}
+
+int TreePlruPolicy::findVictim(const uint32_t setIdx, const std::vector<int>& reservedWays) {
+  const size_t setStart = size_t(setIdx) * m_associativity;
+  int node = 1;
+  int blockIdx = 0;
+  for (int level = 0; level < m_numLevels; ++level) {
+    const int isRight = getBit(setStart + node);
+    blockIdx = (blockIdx << 1) | isRight;
+    node = 2 * node + isRight;
+  }
+  return skipReserved(reservedWays, blockIdx, m_associativity);
+}
+
+RripPolicy::RripPolicy(const int numSets, const int associativity, const bool isBimodal) : m_associativity(associativity),
+    m_isBimodal(isBimodal), m_rrpvs(size_t(numSets) * associativity, MAX_RRPV) {}
+
+void RripPolicy::touch(const uint32_t setIdx, const int blockIdx) {
+  m_rrpvs[size_t(setIdx) * m_associativity + blockIdx] = 0; // hit promotion, predicted near re-reference
+}
+
+void RripPolicy::insert(const uint32_t setIdx, const int blockIdx) {
+  const bool isLong = !m_isBimodal || (m_numInserts++ % BIMODAL_INTERVAL == 0);
+  m_rrpvs[size_t(setIdx) * m_associativity + blockIdx] = isLong ? MAX_RRPV - 1 : MAX_RRPV;
+}
+
+int RripPolicy::findVictim(const uint32_t setIdx, const std::vector<int>& reservedWays) {
+  uint8_t* rrpvs = &m_rrpvs[size_t(setIdx) * m_associativity];
+  // Age the whole set at once by as much as it takes for a candidate to reach the distant prediction
+  uint8_t maxRrpv = 0;
+  int victimIdx = -1;
+  for (int blockIdx = 0; blockIdx < m_associativity; ++blockIdx) {
+    if (rrpvs[blockIdx] > maxRrpv && !isReserved(reservedWays, blockIdx)) {
+      maxRrpv = rrpvs[blockIdx];
+      victimIdx = blockIdx;
+      if (maxRrpv == MAX_RRPV) return victimIdx;
+    }
+  }
+  const uint8_t age = MAX_RRPV - maxRrpv;
+  for (int blockIdx = 0; blockIdx < m_associativity; ++blockIdx) {
+    rrpvs[blockIdx] = std::min<int>(rrpvs[blockIdx] + age, MAX_RRPV);
+  }
+  return (victimIdx >= 0) ? victimIdx : skipReserved(reservedWays, 0, m_associativity);
+}
+
+int RandomPolicy::findVictim(const uint32_t, const std::vector<int>& reservedWays) {
+  m_state ^= m_state << 13;
+  m_state ^= m_state >> 17;
+  m_state ^= m_state << 5;
+  return skipReserved(reservedWays, m_state % m_associativity, m_associativity);
+}
+} // namespace
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Replacement {
+constexpr char LRU_STRING[] = "lru";
+constexpr char TREE_PLRU_STRING[] = "plru";
+constexpr char SRRIP_STRING[] = "srrip";
+constexpr char BRRIP_STRING[] = "brrip";
+constexpr char RANDOM_STRING[] = "random";
+constexpr int MAX_LRU_ASSOCIATIVITY = 1 << 16; // recency lists link ways with 16 bit indices
+
+enum REPLACEMENT_POLICY : uint8_t {
+  LRU, // exact recency order as a linked list of ways per set
+  TREE_PLRU, // binary tree of associativity - 1 bits per set, power of two associativity only
+  SRRIP, // 2 bit re-reference prediction per line, new lines predicted to be re-referenced after a long interval
+  BRRIP, // as SRRIP but new lines mostly predicted distant, resisting scans larger than the cache
+  RANDOM
+};
+
+std::string toString(REPLACEMENT_POLICY policy);
+// Prints an error and returns false if the policy can not manage sets of this associativity
+bool isSupported(const REPLACEMENT_POLICY policy, const int associativity);
+
+// Replacement state for every set of one cache. Invalid ways are always filled before asking for a victim
+class ReplacementPolicy {
+public:
+  virtual ~ReplacementPolicy() = default;
+
+  // The line in the way was accessed
+  virtual void touch(const uint32_t setIdx, const int blockIdx) = 0;
+  // A new block was placed in the way
+  virtual void insert(const uint32_t setIdx, const int blockIdx) {touch(setIdx, blockIdx);}
+  // Way to evict from a full set other than the reserved ways, of which there must be fewer than the associativity
+  virtual int findVictim(const uint32_t setIdx, const std::vector<int>& reservedWays) = 0;
+};
+
+std::unique_ptr<ReplacementPolicy> makeReplacementPolicy(const REPLACEMENT_POLICY policy, const int numSets, const int associativity);
+
+class LruPolicy : public ReplacementPolicy {
+public:
+  LruPolicy(const int numSets, const int associativity);
+  void touch(const uint32_t setIdx, const int blockIdx) override;
+  int findVictim(const uint32_t setIdx, const std::vector<int>& reservedWays) override;
+
+private:
+  const int m_associativity;
+  // Ways of each set from most to least recently used, linked through the indices of the lines before and after them
+  std::vector<uint16_t> m_prev;
+  std::vector<uint16_t> m_next;
+  std::vector<uint16_t> m_mru;
+  std::vector<uint16_t> m_lru;
+};
+
+class TreePlruPolicy : public ReplacementPolicy {
+public:
+  TreePlruPolicy(const int numSets, const int associativity);
+  void touch(const uint32_t setIdx, const int blockIdx) override;
+  int findVictim(const uint32_t setIdx, const std::vector<int>& reservedWays) override;
+
+private:
+  bool getBit(const size_t bitIdx) const {return (m_bits[bitIdx / 64] >> (bitIdx % 64)) & 1;}
+
+  const int m_associativity;
+  const int m_numLevels;
+  // Nodes 1 to associativity - 1 of each set's tree, heap ordered. A set bit points the victim search right
+  std::vector<uint64_t> m_bits;
+};
+
+class RripPolicy : public ReplacementPolicy {
+public:
+  static constexpr uint8_t MAX_RRPV = 3;
+  static constexpr int BIMODAL_INTERVAL = 32; // BRRIP inserts one in this many lines as SRRIP would
+
+  RripPolicy(const int numSets, const int associativity, const bool isBimodal);
+  void touch(const uint32_t setIdx, const int blockIdx) override;
+  void insert(const uint32_t setIdx, const int blockIdx) override;
+  int findVictim(const uint32_t setIdx, const std::vector<int>& reservedWays) override;
+
+private:
+  const int m_associativity;
+  const bool m_isBimodal;
+  int m_numInserts = 0; // deterministic stand in for BRRIP's random choice
+  std::vector<uint8_t> m_rrpvs; // re-reference prediction value per line, MAX_RRPV for the most distant
+};
+
+class RandomPolicy : public ReplacementPolicy {
+public:
+  explicit RandomPolicy(const int associativity) : m_associativity(associativity) {}
+  void touch(const uint32_t, const int) override {}
+  int findVictim(const uint32_t setIdx, const std::vector<int>& reservedWays) override;
+
+private:
+  const int m_associativity;
+  uint32_t m_state = 0x9E3779B9; // xorshift state, fixed so runs are repeatable
+};
+} // namespace
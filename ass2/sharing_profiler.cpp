@@ -0,0 +1,96 @@
+#include "sharing_profiler.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace Sharing {
+
+SharingProfiler::SharingProfiler(const int numCores, const int numLines, const int blockSize, const int numTopLines)
+    : m_blockSize(blockSize), m_numTopLines(numTopLines), m_accessedWordsByCore(numCores, std::vector<uint64_t>(numLines, 0)),
+      m_slots(INITIAL_SLOTS, LineProfile{EMPTY_SLOT, 0, 0, 0, 0, 0, 0, -1}), m_slotShift(64 - std::countr_zero(INITIAL_SLOTS)) {
+  while ((blockSize / Architecture::WORD_SIZE_BYTES >> m_wordShift) > 64) {
+    ++m_wordShift;
+  }
+}
+
+void SharingProfiler::recordAccess(const int coreNum, const size_t lineIdx, const uint64_t address, const bool isStore) {
+  m_accessedWordsByCore[coreNum][lineIdx] |= getWordBit(address);
+  LineProfile& line = findOrInsert(getBlockAddress(address));
+  line.sharers |= uint64_t(1) << coreNum;
+  if (isStore) {
+    line.numPingPongs += (line.lastWriter >= 0 && line.lastWriter != coreNum);
+    line.lastWriter = coreNum;
+  }
+}
+
+void SharingProfiler::recordRemoteWrite(const uint64_t address, const int victimCoreNum, const size_t victimLineIdx, const bool isUpdate) {
+  LineProfile& line = findOrInsert(getBlockAddress(address));
+  ++(isUpdate ? line.numUpdates : line.numInvalidations);
+  ++(m_accessedWordsByCore[victimCoreNum][victimLineIdx] & getWordBit(address) ? line.numTrueSharing : line.numFalseSharing);
+}
+
+SharingProfiler::LineProfile& SharingProfiler::findOrInsert(const uint64_t blockAddress) {
+  const size_t mask = m_slots.size() - 1;
+  for (size_t slotIdx = (blockAddress / m_blockSize * 0x9E3779B97F4A7C15ull) >> m_slotShift;; slotIdx = (slotIdx + 1) & mask) {
+    LineProfile& line = m_slots[slotIdx];
+    if (line.blockAddress == blockAddress) {
+      return line;
+    }
+    if (line.blockAddress == EMPTY_SLOT) {
+      if (2 * (m_numUsedSlots + 1) > m_slots.size()) {
+        grow();
+        return findOrInsert(blockAddress);
+      }
+      ++m_numUsedSlots;
+      line.blockAddress = blockAddress;
+      return line;
+    }
+  }
+}
+
+void SharingProfiler::grow() {
+  std::vector<LineProfile> oldSlots(m_slots.size() * 2, LineProfile{EMPTY_SLOT, 0, 0, 0, 0, 0, 0, -1});
+  oldSlots.swap(m_slots);
+  --m_slotShift;
+  m_numUsedSlots = 0;
+  for (const LineProfile& oldLine : oldSlots) {
+    if (oldLine.blockAddress != EMPTY_SLOT) {
+      findOrInsert(oldLine.blockAddress) = oldLine;
+    }
+  }
+}
+
+void SharingProfiler::fillReport(Architecture::GlobalReport& report) const {
+  report.sharingProfileTopLines = m_numTopLines;
+  report.numProfiledLines = m_numUsedSlots;
+  report.numSharedLines = 0;
+  report.numTrueSharingEvents = 0;
+  report.numFalseSharingEvents = 0;
+  report.numOwnershipPingPongs = 0;
+  std::vector<const LineProfile*> sharedLines;
+  for (const LineProfile& line : m_slots) {
+    if (line.blockAddress == EMPTY_SLOT) continue;
+    report.numTrueSharingEvents += line.numTrueSharing;
+    report.numFalseSharingEvents += line.numFalseSharing;
+    report.numOwnershipPingPongs += line.numPingPongs;
+    if (std::popcount(line.sharers) > 1) {
+      ++report.numSharedLines;
+      sharedLines.push_back(&line);
+    }
+  }
+
+  // Hottest first, ties broken by address so the report does not depend on the table layout
+  auto isHotter = [](const LineProfile* a, const LineProfile* b) {
+    const uint64_t aEvents = uint64_t(a->numInvalidations) + a->numUpdates;
+    const uint64_t bEvents = uint64_t(b->numInvalidations) + b->numUpdates;
+    return aEvents != bEvents ? aEvents > bEvents : a->blockAddress < b->blockAddress;
+  };
+  const size_t numTopLines = std::min(sharedLines.size(), size_t(m_numTopLines));
+  std::partial_sort(sharedLines.begin(), sharedLines.begin() + numTopLines, sharedLines.end(), isHotter);
+  report.hottestSharedLines.clear();
+  for (size_t lineIdx = 0; lineIdx < numTopLines; ++lineIdx) {
+    const LineProfile& line = *sharedLines[lineIdx];
+    report.hottestSharedLines.push_back({line.blockAddress, line.sharers, line.numInvalidations, line.numUpdates, line.numPingPongs, line.numTrueSharing, line.numFalseSharing});
+  }
+}
+} // namespace
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "architecture.h"
+
+namespace Sharing {
+constexpr int MAX_PROFILED_CORES = 64; // sharer sets are a bit per core
+constexpr int DEFAULT_TOP_LINES = 10;
+constexpr uint64_t EMPTY_SLOT = UINT64_MAX; // block address of an unused hash table slot, never a block start
+constexpr size_t INITIAL_SLOTS = 1 << 12;
+
+// Per block coherence activity, tracking invalidations and updates of other cores' copies and classifying each as true
+// sharing if the victim core had accessed the written word since the copy arrived, else false sharing. Word accesses
+// are kept per L1 line as a bit mask, blocks of more than 64 words share a bit between neighbouring words
+class SharingProfiler {
+public:
+  SharingProfiler(const int numCores, const int numLines, const int blockSize, const int numTopLines);
+
+  // A new block was placed in the core's L1 line, forgetting the words accessed in the old one
+  void resetLine(const int coreNum, const size_t lineIdx) {m_accessedWordsByCore[coreNum][lineIdx] = 0;}
+  // The core accessed the address through its L1 line, a store by another core than the block's last writer
+  // moves its ownership
+  void recordAccess(const int coreNum, const size_t lineIdx, const uint64_t address, const bool isStore);
+  // A store to the address by another core invalidated or updated the victim core's copy in its L1 line
+  void recordRemoteWrite(const uint64_t address, const int victimCoreNum, const size_t victimLineIdx, const bool isUpdate);
+
+  // Totals over every block and the hottest blocks by invalidations plus updates
+  void fillReport(Architecture::GlobalReport& report) const;
+
+private:
+  // Open addressed with linear probing, 40 bytes a block so large traces stay cheap to profile. Counts are 32 bit
+  struct LineProfile {
+    uint64_t blockAddress;
+    uint64_t sharers; // bit per core that accessed the block
+    uint32_t numInvalidations;
+    uint32_t numUpdates;
+    uint32_t numPingPongs; // stores moving ownership away from the previous writer
+    uint32_t numTrueSharing;
+    uint32_t numFalseSharing;
+    int16_t lastWriter; // -1 until the block is stored to
+  };
+
+  uint64_t getBlockAddress(const uint64_t address) const {return address & ~uint64_t(m_blockSize - 1);}
+  uint64_t getWordBit(const uint64_t address) const {
+    return uint64_t(1) << ((address & (m_blockSize - 1)) / Architecture::WORD_SIZE_BYTES >> m_wordShift);
+  }
+  LineProfile& findOrInsert(const uint64_t blockAddress);
+  // Doubles the table, rehashing every block into it
+  void grow();
+
+  const int m_blockSize;
+  const int m_numTopLines;
+  int m_wordShift = 0; // words per mask bit, as a power of two
+  std::vector<std::vector<uint64_t>> m_accessedWordsByCore; // per line, like the L1Cache arrays
+  std::vector<LineProfile> m_slots; // power of two sized, at most half full
+  int m_slotShift; // 64 - log2 of the number of slots, for the multiplicative hash
+  size_t m_numUsedSlots = 0;
+};
+} // namespace
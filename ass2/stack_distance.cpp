@@ -0,0 +1,107 @@
+#include "stack_distance.h"
+#include "architecture.h"
+#include "cache.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace StackDistance {
+
+namespace {
+  // LRU stacks of every set for one set count and block size, deep enough for the largest associativity using them.
+  // An access at stack depth d hits in every cache of this set count with associativity greater than d
+  class SetStacks {
+  public:
+    SetStacks(const Cache::CacheGeometry& geometry, const int depth) : m_geometry(geometry), m_depth(depth),
+      m_tags(geometry.numSets * depth), m_fill(geometry.numSets), m_hitsAtDepth(depth) {}
+
+    bool matches(const Cache::CacheGeometry& geometry) const {
+      return m_geometry.numSets == geometry.numSets && m_geometry.blockSize == geometry.blockSize;
+    }
+
+    void reset() {
+      std::fill(m_fill.begin(), m_fill.end(), 0);
+    }
+
+    void access(const uint64_t address) {
+      const uint32_t setIdx = m_geometry.getSetIdx(address);
+      const uint64_t tag = m_geometry.getTag(address);
+      uint64_t* stack = m_tags.data() + setIdx * m_depth;
+      int& fill = m_fill[setIdx];
+
+      int depth = std::find(stack, stack + fill, tag) - stack;
+      if (depth < fill) {
+        ++m_hitsAtDepth[depth];
+      } else if (fill < m_depth) {
+        depth = fill++; // cold or evicted from every cache, grow the stack
+      } else {
+        depth = m_depth - 1; // deeper than any cache, drop the bottom of the stack
+      }
+      std::copy_backward(stack, stack + depth, stack + depth + 1); // move to top of stack
+      stack[0] = tag;
+    }
+
+    // Number of accesses that would hit in a cache of this set count with the given associativity
+    long long getHits(const int associativity) const {
+      long long hits = 0;
+      for (int depth = 0; depth < associativity; ++depth) {
+        hits += m_hitsAtDepth[depth];
+      }
+      return hits;
+    }
+
+  private:
+    Cache::CacheGeometry m_geometry; // only the set index and tag decomposition is used
+    int m_depth;
+    std::vector<uint64_t> m_tags; // stack for set s at [s * depth, s * depth + fill), most recently used first
+    std::vector<int> m_fill;
+    std::vector<long long> m_hitsAtDepth;
+  };
+}
+
+bool runStackDistance(const std::vector<std::vector<Architecture::Instruction>>& instructionsByCore, const std::vector<Cache::CacheGeometry>& geometries, std::ostream& table) {
+  // Geometries sharing a set count and block size only differ by associativity so can share stacks
+  std::vector<SetStacks> setStacks;
+  std::vector<int> stacksIdxByGeometry;
+  for (const Cache::CacheGeometry& geometry : geometries) {
+    int maxAssociativity = 0;
+    for (const Cache::CacheGeometry& other : geometries) {
+      if (other.numSets == geometry.numSets && other.blockSize == geometry.blockSize) {
+        maxAssociativity = std::max(maxAssociativity, other.associativity);
+      }
+    }
+    auto it = std::find_if(setStacks.begin(), setStacks.end(), [&](const SetStacks& stacks) {return stacks.matches(geometry);});
+    if (it == setStacks.end()) {
+      it = setStacks.emplace(setStacks.end(), geometry, maxAssociativity);
+    }
+    stacksIdxByGeometry.push_back(it - setStacks.begin());
+  }
+
+  // Caches are private so each core starts from empty stacks, hits accumulate across cores
+  long long numAccesses = 0;
+  for (const std::vector<Architecture::Instruction>& instructions : instructionsByCore) {
+    for (SetStacks& stacks : setStacks) {
+      stacks.reset();
+    }
+    for (const Architecture::Instruction& instruction : instructions) {
+      if (instruction.instType == Architecture::COMPUTE) {
+        continue;
+      }
+      ++numAccesses;
+      for (SetStacks& stacks : setStacks) {
+        stacks.access(instruction.dataAddress);
+      }
+    }
+  }
+
+  table << "cache_size,associativity,block_size,cache_hits,cache_misses,cache_hit_rate\n";
+  for (int geometryIdx = 0; geometryIdx < geometries.size(); ++geometryIdx) {
+    const Cache::CacheGeometry& geometry = geometries[geometryIdx];
+    const long long hits = setStacks[stacksIdxByGeometry[geometryIdx]].getHits(geometry.associativity);
+    table << geometry.cacheSize << ',' << geometry.associativity << ',' << geometry.blockSize << ','
+          << hits << ',' << numAccesses - hits << ',' << double(hits) / double(numAccesses) << '\n';
+  }
+  return table.good();
+}
+
+} // namespace
@@ -0,0 +1,13 @@
+#pragma once
+#include <ostream>
+#include <vector>
+
+#include "architecture.h"
+#include "cache.h"
+
+namespace StackDistance {
+// Computes the hit and miss counts of private LRU L1 caches for every geometry in a single pass over each core's
+// trace, using a per-set Mattson stack. Coherence is not modelled so lines are never invalidated by other cores.
+// Writes one row per geometry to table in the order given. Returns false if the table could not be written
+bool runStackDistance(const std::vector<std::vector<Architecture::Instruction>>& instructionsByCore, const std::vector<Cache::CacheGeometry>& geometries, std::ostream& table);
+} // namespace
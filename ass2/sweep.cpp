@@ -0,0 +1,68 @@
+#include "sweep.h"
+#include "architecture.h"
+#include "cache.h"
+#include "processor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <numeric>
+#include <thread>
+
+namespace Sweep {
+
+bool runSweep(std::shared_ptr<const std::vector<std::vector<Architecture::Instruction>>> instructionsByCorePtr, const std::vector<Processor::CPUConfig>& configs, int numThreads, std::ostream& table) {
+  // Each configuration gets its own CPU, memory system and report, only the instructions are shared
+  std::vector<Architecture::GlobalReport> reports(configs.size());
+  std::atomic<int> nextConfigIdx = 0;
+  std::atomic<int> numCompleted = 0;
+  std::unique_ptr<bool[]> hasFailed = std::make_unique<bool[]>(configs.size()); // written by one worker each
+  auto sweepWorker = [&]() {
+    for (int configIdx = nextConfigIdx++; configIdx < configs.size(); configIdx = nextConfigIdx++) {
+      Processor::CPUConfig config = configs[configIdx];
+      config.memoryConfig.quiet = true; // stdout may be the table
+      Processor::CPU cpu(instructionsByCorePtr, config);
+      if (!cpu.isValid()) {
+        hasFailed[configIdx] = true;
+        std::cerr << "Failed configuration " << configIdx + 1 << "/" << configs.size() << '\n';
+        continue;
+      }
+      cpu.simulate();
+      reports[configIdx] = cpu.getReport();
+      std::cerr << "Completed configuration " << ++numCompleted << "/" << configs.size() << '\n';
+    }
+  };
+
+  numThreads = std::clamp<int>(numThreads, 1, configs.size());
+  std::vector<std::thread> sweepThreads;
+  for (int threadIdx = 0; threadIdx < numThreads; ++threadIdx) {
+    sweepThreads.emplace_back(sweepWorker);
+  }
+  for (std::thread& sweepThread : sweepThreads) {
+    sweepThread.join();
+  }
+
+  table << "protocol,cache_size,associativity,block_size,execution_cycles,compute_cycles,idle_cycles,cache_hit_rate,bus_data_traffic_bytes,bus_invalidations_or_updates,private_data_access,shared_data_access,cache_to_cache_transfers,avg_cache_to_cache_transfer_cycles\n";
+  bool success = true;
+  for (int configIdx = 0; configIdx < configs.size(); ++configIdx) {
+    if (hasFailed[configIdx]) {
+      success = false;
+      continue;
+    }
+    const Cache::CacheGeometry& geometry = configs[configIdx].geometry;
+    const Architecture::GlobalReport& report = reports[configIdx];
+    const long long computeCycles = std::accumulate(report.computeCycles.begin(), report.computeCycles.end(), 0LL);
+    const long long idleCycles = std::accumulate(report.idleCycles.begin(), report.idleCycles.end(), 0LL);
+    const long long cacheHits = std::accumulate(report.numCacheHits.begin(), report.numCacheHits.end(), 0LL);
+    const long long cacheMisses = std::accumulate(report.numCacheMisses.begin(), report.numCacheMisses.end(), 0LL);
+    table << Cache::toString(configs[configIdx].protocol) << ',' << geometry.cacheSize << ',' << geometry.associativity << ',' << geometry.blockSize << ','
+          << report.overallExecutionCycles << ',' << computeCycles << ',' << idleCycles << ','
+          << double(cacheHits) / double(cacheHits + cacheMisses) << ','
+          << report.busDataTrafficBytes << ',' << report.busInvalidationsOrUpdates << ','
+          << report.numPrivateAccess << ',' << report.numSharedAccess << ','
+          << report.numCacheToCacheTransfers << ',' << (report.numCacheToCacheTransfers ? double(report.cacheToCacheTransferCycles) / report.numCacheToCacheTransfers : 0.0) << '\n';
+  }
+  return success && table.good();
+}
+
+} // namespace
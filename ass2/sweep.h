@@ -0,0 +1,14 @@
+#pragma once
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "architecture.h"
+#include "processor.h"
+
+namespace Sweep {
+// Simulates every configuration over the same instructions on a pool of numThreads threads,
+// then writes one row per configuration to table in the order given, skipping configurations that failed.
+// Returns false if any configuration failed or the table could not be written
+bool runSweep(std::shared_ptr<const std::vector<std::vector<Architecture::Instruction>>> instructionsByCorePtr, const std::vector<Processor::CPUConfig>& configs, int numThreads, std::ostream& table);
+} // namespace
@@ -0,0 +1,42 @@
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+#include "architecture.h"
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::fprintf(stderr, "Invalid Usage, please input ./trace-convert <input_file> [output_file] [--coalesce]\n");
+    return 1;
+  }
+
+  // Parse arguments
+  std::filesystem::path inputPath = argv[1];
+  std::filesystem::path outputPath = inputPath;
+  outputPath.replace_extension(Architecture::BINARY_TRACE_EXTENSION);
+  bool coalesceCompute = false;
+  for (int argIdx = 2; argIdx < argc; ++argIdx) {
+    if (!std::strcmp(argv[argIdx], "--coalesce")) {
+      coalesceCompute = true;
+    } else if (std::strncmp(argv[argIdx], "--", 2)) {
+      outputPath = argv[argIdx];
+    } else {
+      std::fprintf(stderr, "Error: Unknown option %s\n", argv[argIdx]);
+      return 1;
+    }
+  }
+
+  std::vector<Architecture::Instruction> instructions;
+  if (!Architecture::loadInstructionsFromFile(inputPath, instructions)) {
+    std::fprintf(stderr, "Error: Failed to load trace %s\n", inputPath.c_str());
+    return 1;
+  }
+
+  if (!Architecture::writeBinaryTrace(outputPath, instructions, coalesceCompute)) {
+    std::fprintf(stderr, "Error: Failed to write binary trace %s\n", outputPath.c_str());
+    return 1;
+  }
+  std::cout << "Converted " << instructions.size() << " instructions from " << inputPath.string() << " to " << outputPath.string() << '\n';
+}